@@ -0,0 +1,230 @@
+#include "aliasbench.h"
+
+#include <stdlib.h>
+
+namespace cult {
+
+// Default distances between the store stream and the load stream, exact multiples of 4096 are expected to alias.
+static const uint32_t alias_default_distances[] = {
+  4, 64, 1024, 2048, 4032, 4092, 4096, 4100, 4160, 8192, 12288, 16384, 32768
+};
+
+// Size of stores and loads, shorter distances overlap and measure store forwarding instead of aliasing.
+static const uint32_t alias_access_size = 4;
+
+// Distance that doesn't alias, used as a baseline.
+static const uint32_t alias_baseline_distance = 2048 + 64;
+
+// Penalty (in cycles per store/load pair) that is considered aliasing.
+static const double alias_penalty_threshold = 0.5;
+
+static const char* alias_pattern_name(uint32_t pattern) {
+  switch (pattern) {
+    case AliasBench::kPatternNoStore  : return "no-store";
+    case AliasBench::kPatternNoAlias  : return "no-alias";
+    case AliasBench::kPatternAlias    : return "alias";
+    case AliasBench::kPatternAlternate: return "alternate";
+    default                           : return "unknown";
+  }
+}
+
+// ============================================================================
+// [cult::AliasBench]
+// ============================================================================
+
+AliasBench::AliasBench(App* app)
+  : BaseBench(app),
+    _mode(0),
+    _distance(0),
+    _pattern(0),
+    _n_unroll(64),
+    _data_size(65536) {
+
+  _data = calloc(1, _data_size + 4096);
+  lock_data(_data, _data_size + 4096);
+  _aligned_data = reinterpret_cast<uint8_t*>((uintptr_t(_data) + 4095u) & ~uintptr_t(4095u));
+}
+
+AliasBench::~AliasBench() {
+  free(_data);
+}
+
+uint32_t AliasBench::local_stack_size() const {
+  return 0;
+}
+
+// Distances can be specified as `--alias-distances=4096,8192,...`, distances that don't fit the buffer or make the
+// load overlap the store are ignored.
+void AliasBench::parse_distances(std::vector<uint32_t>& dst) const {
+  const char* s = _app->cmd_line().value_of("--alias-distances");
+
+  if (s && *s) {
+    while (*s) {
+      char* end;
+      unsigned long d = strtoul(s, &end, 0);
+
+      if (end == s)
+        break;
+
+      if (d >= alias_access_size && d + 64 <= _data_size)
+        dst.push_back(uint32_t(d));
+
+      s = *end == ',' ? end + 1 : end;
+    }
+  }
+  else {
+    for (uint32_t d : alias_default_distances)
+      dst.push_back(d);
+  }
+}
+
+void AliasBench::run() {
+  JSONBuilder& json = _app->json();
+
+  std::vector<uint32_t> distances;
+  parse_distances(distances);
+
+  if (_app->verbose())
+    printf("Store/load aliasing (cycles per store + load pair):\n");
+
+  double baseline = test_distance(alias_baseline_distance);
+
+  json.before_record()
+      .add_key("storeLoadAliasing")
+      .open_array();
+
+  for (uint32_t distance : distances) {
+    double cycles = test_distance(distance);
+    double penalty = std::max<double>(cycles - baseline, 0);
+    bool aliased = penalty >= alias_penalty_threshold;
+
+    if (_app->verbose()) {
+      printf("  Distance %-8u: Cycles:%7.2f Baseline:%7.2f Penalty:%7.2f%s\n",
+        distance, cycles, baseline, penalty, aliased ? " (aliased)" : "");
+    }
+
+    json.before_record()
+        .open_object()
+        .add_key("distance").add_uint(distance)
+        .add_key("cycles").add_doublef("%7.2f", cycles)
+        .add_key("baselineCycles").add_doublef("%7.2f", baseline)
+        .add_key("penalty").add_doublef("%7.2f", penalty)
+        .add_key("aliased").add_bool(aliased)
+        .close_object();
+  }
+
+  json.close_array(true);
+
+  if (_app->verbose())
+    printf("\nMemory disambiguation (cycles per store + load in a chain):\n");
+
+  double noStore = test_disambiguation(kPatternNoStore);
+
+  json.before_record()
+      .add_key("memoryDisambiguation")
+      .open_array();
+
+  for (uint32_t pattern = kPatternNoAlias; pattern < kPatternCount; pattern++) {
+    double cycles = test_disambiguation(pattern);
+    double penalty = std::max<double>(cycles - noStore, 0);
+
+    if (_app->verbose()) {
+      printf("  %-16s: Cycles:%7.2f Baseline:%7.2f Penalty:%7.2f\n",
+        alias_pattern_name(pattern), cycles, noStore, penalty);
+    }
+
+    json.before_record()
+        .open_object()
+        .add_key("pattern").add_string(alias_pattern_name(pattern)).align_to(32)
+        .add_key("cycles").add_doublef("%7.2f", cycles)
+        .add_key("baselineCycles").add_doublef("%7.2f", noStore)
+        .add_key("penalty").add_doublef("%7.2f", penalty)
+        .close_object();
+  }
+
+  if (_app->verbose())
+    printf("\n");
+
+  json.close_array(true);
+}
+
+double AliasBench::test_distance(uint32_t distance) {
+  _mode = kModeDistance;
+  _distance = distance;
+  return test_func();
+}
+
+double AliasBench::test_disambiguation(uint32_t pattern) {
+  _mode = kModeDisambiguation;
+  _pattern = pattern;
+  return test_func();
+}
+
+double AliasBench::test_func() {
+  Func func = compile_func();
+  if (!func) {
+    printf("FAILED to compile function for aliasing test\n");
+    return -1.0;
+  }
+
+  uint32_t nIter = 160;
+  uint64_t best = measure_best(func, nIter);
+
+  release_func(func);
+  return double(best) / (double(nIter * _n_unroll));
+}
+
+void AliasBench::before_body(x86::Assembler& a) {
+  (void)a;
+}
+
+void AliasBench::compile_body(x86::Assembler& a, x86::Gp reg_cnt) {
+  x86::Gp base = a.zsi();
+  x86::Gp index = a.zdi();
+  x86::Gp value = a.zcx();
+
+  // The stored value and the stored address (base + index) are always zero, so all loads read zero.
+  a.mov(base, uintptr_t(_aligned_data));
+  a.xor_(x86::eax, x86::eax);
+  a.xor_(x86::ecx, x86::ecx);
+  a.xor_(x86::edi, x86::edi);
+
+  Label L_Body = a.new_label();
+  Label L_End = a.new_label();
+
+  a.test(reg_cnt, reg_cnt);
+  a.jz(L_End);
+
+  a.align(AlignMode::kCode, 64);
+  a.bind(L_Body);
+
+  for (uint32_t n = 0; n < _n_unroll; n++) {
+    if (_mode == kModeDistance) {
+      // Loads are independent of stores, they only compete with them if their addresses alias.
+      a.mov(x86::dword_ptr(base), x86::eax);
+      a.mov(x86::edx, x86::dword_ptr(base, int32_t(_distance)));
+    }
+    else {
+      // Two multiplications by one delay the store address, the loaded value closes the chain.
+      a.imul(index, index, 1);
+      a.imul(index, index, 1);
+
+      if (_pattern != kPatternNoStore)
+        a.mov(x86::dword_ptr(base, index), x86::eax);
+
+      bool alias = _pattern == kPatternAlias || (_pattern == kPatternAlternate && (n & 1) == 0);
+      a.mov(value.r32(), x86::dword_ptr(base, alias ? 0 : 64));
+      a.add(index, value);
+    }
+  }
+
+  a.sub(reg_cnt, 1);
+  a.jnz(L_Body);
+  a.bind(L_End);
+}
+
+void AliasBench::after_body(x86::Assembler& a) {
+  (void)a;
+}
+
+} // {cult} namespace
@@ -0,0 +1,69 @@
+#ifndef _CULT_ALIASBENCH_H
+#define _CULT_ALIASBENCH_H
+
+#include <vector>
+
+#include "basebench.h"
+
+namespace cult {
+
+// ============================================================================
+// [cult::AliasBench]
+// ============================================================================
+
+// Measures false store/load dependencies and memory disambiguation.
+//
+// The first test interleaves a store stream and a load stream separated by a distance. Loads never read the
+// stored data, however, if the distance is a multiple of 4096 the CPU compares only the lower 12 bits of the
+// addresses and the load waits for the store (4K aliasing).
+//
+// The second test executes a store, which address is known late, followed by a load in a dependency chain. The
+// load either doesn't alias the store (the CPU has to predict that it can execute before the store address is
+// known), always aliases it (the value is forwarded from the store), or aliases it every second time.
+class AliasBench : public BaseBench {
+public:
+  enum Mode : uint32_t {
+    kModeDistance,
+    kModeDisambiguation
+  };
+
+  enum Pattern : uint32_t {
+    kPatternNoStore,
+    kPatternNoAlias,
+    kPatternAlias,
+    kPatternAlternate,
+
+    kPatternCount
+  };
+
+  AliasBench(App* app);
+  virtual ~AliasBench();
+
+  inline bool is_64bit() const {
+    return Environment::is_64bit(Arch::kHost);
+  }
+
+  void parse_distances(std::vector<uint32_t>& dst) const;
+  double test_distance(uint32_t distance);
+  double test_disambiguation(uint32_t pattern);
+  double test_func();
+
+  uint32_t local_stack_size() const override;
+  void run() override;
+  void before_body(x86::Assembler& a) override;
+  void compile_body(x86::Assembler& a, x86::Gp reg_cnt) override;
+  void after_body(x86::Assembler& a) override;
+
+  uint32_t _mode {};
+  uint32_t _distance {};
+  uint32_t _pattern {};
+  uint32_t _n_unroll {};
+
+  void* _data {};
+  uint32_t _data_size {};
+  uint8_t* _aligned_data {};
+};
+
+} // {cult} namespace
+
+#endif // _CULT_ALIASBENCH_H
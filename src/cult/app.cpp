@@ -1,9 +1,23 @@
 #include <stdlib.h>
 
+#include "aliasbench.h"
 #include "app.h"
+#include "avxfreqbench.h"
+#include "contentionbench.h"
+#include "copybench.h"
+#include "cpuutils.h"
 #include "cpudetect.h"
+#include "envcheck.h"
+#include "faultbench.h"
+#include "fencebench.h"
+#include "flushbench.h"
+#include "gatherbench.h"
 #include "instbench.h"
+#include "partialbench.h"
+#include "prefetchbench.h"
 #include "schedutils.h"
+#include "splitbench.h"
+#include "tlbbench.h"
 
 namespace cult {
 
@@ -13,12 +27,42 @@ App::App(int argc, char* argv[])
 
 App::~App() {}
 
+uint64_t App::tsc_freq() {
+  if (!_tsc_freq_queried) {
+    _tsc_freq = CpuUtils::get_tsc_freq();
+    _tsc_freq_queried = true;
+  }
+  return _tsc_freq;
+}
+
 void App::parse_arguments() {
   if (_cmd.has_key("--help")) _help = true;
   if (_cmd.has_key("--dump")) _dump = true;
   if (_cmd.has_key("--quiet")) _verbose = false;
   if (_cmd.has_key("--estimate")) _estimate = true;
   if (_cmd.has_key("--no-rounding")) _round = false;
+  if (_cmd.has_key("--sweep-chains")) _sweep_chains = true;
+  if (_cmd.has_key("--unroll-fit")) _unroll_fit = true;
+  if (_cmd.has_key("--track-freq")) _track_freq = true;
+  if (_cmd.has_key("--strict-env")) _strict_env = true;
+  if (_cmd.has_key("--isolate")) _isolate = true;
+  if (_cmd.has_key("--idioms")) _idioms = true;
+  if (_cmd.has_key("--partial")) _partial = true;
+  if (_cmd.has_key("--addressing")) _addressing = true;
+  if (_cmd.has_key("--split")) _split = true;
+  if (_cmd.has_key("--alias")) _alias = true;
+  if (_cmd.has_key("--gather")) _gather = true;
+  if (_cmd.has_key("--modifiers")) _modifiers = true;
+  if (_cmd.has_key("--contention")) _contention = true;
+  if (_cmd.has_key("--fences")) _fences = true;
+  if (_cmd.has_key("--copy")) _copy = true;
+  if (_cmd.has_key("--prefetch")) _prefetch = true;
+  if (_cmd.has_key("--flush")) _flush = true;
+  if (_cmd.has_key("--tlb")) _tlb = true;
+  if (_cmd.has_key("--faults")) _faults = true;
+  if (_cmd.has_key("--avx-freq")) _avx_freq = true;
+  if (_cmd.has_key("--all-core")) _all_core = true;
+  if (_cmd.has_key("--no-instructions")) _instructions = false;
 
   if (help() || verbose()) {
     printf("CULT v%u.%u.%u [Using AsmJit v%u.%u.%u]\n",
@@ -38,7 +82,32 @@ void App::parse_arguments() {
     printf("  --quiet            - Quiet mode, no output except final JSON\n");
     printf("  --estimate         - Estimate only (faster, but less precise)\n");
     printf("  --no-rounding      - Don't round cycles and latencies\n");
+    printf("  --sweep-chains     - Sweep the number of parallel chains to saturate throughput\n");
+    printf("  --unroll-fit       - Fit cycles over unroll counts instead of subtracting overhead kernels\n");
+    printf("  --track-freq       - Track the core/TSC frequency ratio and report core cycles and nanoseconds\n");
+    printf("  --isolate          - Run at real-time priority with locked memory on a CPU not used by worker threads (Linux only)\n");
+    printf("  --strict-env       - Refuse to run if the environment is noisy (governor, turbo, SMT, load)\n");
+    printf("  --idioms           - Detect zero idioms, dependency breaking, and move elimination\n");
+    printf("  --modifiers        - Benchmark AVX-512 masking, embedded broadcast, and embedded rounding\n");
+    printf("  --partial          - Benchmark partial register and partial flags stalls\n");
+    printf("  --addressing       - Benchmark memory operands with different addressing forms\n");
+    printf("  --split            - Benchmark cache line and page split penalties\n");
+    printf("  --alias            - Benchmark 4K aliasing and memory disambiguation\n");
+    printf("  --alias-distances=a,b,... - Store/load distances used by --alias\n");
+    printf("  --gather           - Benchmark gathers and scatters with different index patterns and masks\n");
+    printf("  --contention       - Benchmark atomic operations executed by multiple threads\n");
+    printf("  --fences           - Benchmark pause, tpause, umwait, serialize, fences, and cpuid with loads/stores in flight\n");
+    printf("  --copy             - Benchmark memcpy/memset strategies (rep movsb/stosb, GP, SSE, AVX, AVX-512, NT)\n");
+    printf("  --prefetch         - Benchmark software prefetches in cache-missing chase and strided scan\n");
+    printf("  --prefetch-distances=a,b,... - Prefetch distances (in accesses) used by --prefetch\n");
+    printf("  --flush            - Benchmark clflush, clflushopt, clwb, and cldemote on clean and dirty lines\n");
+    printf("  --tlb              - Benchmark TLB reach and page walks with 4KB pages and huge pages\n");
+    printf("  --faults           - Benchmark page faults on first touch of anonymous memory by 1..N threads\n");
+    printf("  --avx-freq         - Benchmark warm-up, frequency, and recovery of 256-bit and 512-bit vector code\n");
+    printf("  --all-core         - Benchmark instruction throughput on 1..N pinned cores at the same time\n");
+    printf("  --no-instructions  - Don't benchmark instructions (only run other benchmarks)\n");
     printf("  --instruction=name - Only benchmark a particular instruction\n");
+    printf("  --time-budget=secs - Measure instructions quickly and refine the most ambiguous results within a time budget\n");
     printf("  --output=file      - end output to file instead of stdout\n");
     printf("\n");
     exit(0);
@@ -52,11 +121,24 @@ void App::parse_arguments() {
       exit(1);
     }
   }
+
+  const char* time_budget = _cmd.value_of("--time-budget");
+  if (time_budget) {
+    _time_budget = atof(time_budget);
+    if (_time_budget <= 0.0) {
+      printf("The time budget '%s' must be a positive number of seconds\n", time_budget);
+      exit(1);
+    }
+  }
 }
 
 int App::run() {
   SchedUtils::set_affinity(0);
 
+  SchedUtils::IsolationInfo isolation {};
+  if (_isolate)
+    SchedUtils::isolate(0, isolation);
+
   _json.open_object();
   _json.before_record()
        .add_key("cult")
@@ -71,10 +153,103 @@ int App::run() {
   }
 
   {
+    EnvCheck env_check(this);
+    if (!env_check.run())
+      return 1;
+  }
+
+  if (_isolate) {
+    if (verbose()) {
+      printf("Isolation:\n");
+      printf("  CPU: %u\n", isolation.cpu);
+      printf("  Realtime: %s\n", isolation.realtime ? "yes" : "no (not permitted)");
+      printf("  MemoryLocked: %s\n", isolation.memory_locked ? "yes" : "no (not permitted)");
+      printf("  Isolated: %s\n", isolation.isolated ? "yes" : "no");
+      printf("  NoHzFull: %s\n", isolation.nohz_full ? "yes" : "no");
+      printf("\n");
+    }
+
+    _json.before_record()
+         .add_key("isolation")
+         .open_object()
+           .before_record().add_key("cpu").add_uint(isolation.cpu)
+           .before_record().add_key("realtime").add_bool(isolation.realtime)
+           .before_record().add_key("memoryLocked").add_bool(isolation.memory_locked)
+           .before_record().add_key("isolated").add_bool(isolation.isolated)
+           .before_record().add_key("nohzFull").add_bool(isolation.nohz_full)
+         .close_object(true);
+  }
+
+  if (_instructions) {
     InstBench inst_bench(this);
     inst_bench.run();
   }
 
+  if (_all_core) {
+    InstBench inst_bench(this);
+    inst_bench.run_all_core();
+  }
+
+  if (_partial) {
+    PartialBench partial_bench(this);
+    partial_bench.run();
+  }
+
+  if (_split) {
+    SplitBench split_bench(this);
+    split_bench.run();
+  }
+
+  if (_alias) {
+    AliasBench alias_bench(this);
+    alias_bench.run();
+  }
+
+  if (_gather) {
+    GatherBench gather_bench(this);
+    gather_bench.run();
+  }
+
+  if (_contention) {
+    ContentionBench contention_bench(this);
+    contention_bench.run();
+  }
+
+  if (_fences) {
+    FenceBench fence_bench(this);
+    fence_bench.run();
+  }
+
+  if (_copy) {
+    CopyBench copy_bench(this);
+    copy_bench.run();
+  }
+
+  if (_prefetch) {
+    PrefetchBench prefetch_bench(this);
+    prefetch_bench.run();
+  }
+
+  if (_flush) {
+    FlushBench flush_bench(this);
+    flush_bench.run();
+  }
+
+  if (_tlb) {
+    TlbBench tlb_bench(this);
+    tlb_bench.run();
+  }
+
+  if (_faults) {
+    FaultBench fault_bench(this);
+    fault_bench.run();
+  }
+
+  if (_avx_freq) {
+    AvxFreqBench avx_freq_bench(this);
+    avx_freq_bench.run();
+  }
+
   _json.nl().close_object().nl();
 
   const char* output_file_name = _cmd.value_of("--output");
@@ -56,8 +56,33 @@ public:
   inline bool help() const { return _help; }
   inline bool verbose() const { return _verbose; }
   inline bool dump() const { return _dump; }
+  inline bool sweep_chains() const { return _sweep_chains; }
+  inline bool idioms() const { return _idioms; }
+  inline bool partial() const { return _partial; }
+  inline bool addressing() const { return _addressing; }
+  inline bool split() const { return _split; }
+  inline bool alias() const { return _alias; }
+  inline bool gather() const { return _gather; }
+  inline bool modifiers() const { return _modifiers; }
+  inline bool contention() const { return _contention; }
+  inline bool fences() const { return _fences; }
+  inline bool copy() const { return _copy; }
+  inline bool prefetch() const { return _prefetch; }
+  inline bool flush() const { return _flush; }
+  inline bool tlb() const { return _tlb; }
+  inline bool faults() const { return _faults; }
+  inline bool avx_freq() const { return _avx_freq; }
+  inline bool all_core() const { return _all_core; }
+  inline double time_budget() const { return _time_budget; }
+  inline bool unroll_fit() const { return _unroll_fit; }
+  inline bool track_freq() const { return _track_freq; }
+  inline bool strict_env() const { return _strict_env; }
+  inline bool isolate() const { return _isolate; }
   inline JSONBuilder& json() { return _json; }
 
+  // Returns the TSC frequency, which is only queried (and calibrated if CPUID doesn't provide it) once.
+  uint64_t tsc_freq();
+
   void parse_arguments();
   int run();
 
@@ -67,7 +92,32 @@ public:
   bool _round = true;
   bool _verbose = true;
   bool _estimate = false;
+  bool _sweep_chains = false;
+  bool _idioms = false;
+  bool _partial = false;
+  bool _addressing = false;
+  bool _split = false;
+  bool _alias = false;
+  bool _gather = false;
+  bool _modifiers = false;
+  bool _contention = false;
+  bool _fences = false;
+  bool _copy = false;
+  bool _prefetch = false;
+  bool _flush = false;
+  bool _tlb = false;
+  bool _faults = false;
+  bool _avx_freq = false;
+  bool _all_core = false;
+  bool _unroll_fit = false;
+  bool _track_freq = false;
+  bool _strict_env = false;
+  bool _isolate = false;
+  bool _instructions = true;
   uint32_t _single_inst_id = 0;
+  double _time_budget = 0.0;
+  uint64_t _tsc_freq = 0;
+  bool _tsc_freq_queried = false;
 
   String _output;
   JSONBuilder _json;
@@ -0,0 +1,285 @@
+#include "avxfreqbench.h"
+
+#include <algorithm>
+
+namespace cult {
+
+static const char* avx_class_name[AvxFreqBench::kClassCount] = {
+  "ymm-light",
+  "ymm-heavy",
+  "zmm-light",
+  "zmm-heavy"
+};
+
+static const char* avx_class_inst[AvxFreqBench::kClassCount] = {
+  "vpaddd ymm",
+  "vfmadd231ps ymm",
+  "vpaddd zmm",
+  "vfmadd231ps zmm"
+};
+
+// Number of dependent additions (and vector instructions in the vector phase) of a single block.
+static constexpr uint32_t kAvxBlockSize = 8;
+
+// Number of blocks of a single window (about 2000 core cycles).
+static constexpr uint32_t kAvxBlocksPerWindow = 256;
+
+// Number of windows of each phase (about 10ms each at 3GHz). The first phase must be long enough for the vector
+// unit to power down and for the frequency to recover after the previous run.
+static constexpr uint32_t kAvxPreWindows = 16384;
+static constexpr uint32_t kAvxVecWindows = 16384;
+static constexpr uint32_t kAvxPostWindows = 16384;
+static constexpr uint32_t kAvxTotalWindows = kAvxPreWindows + kAvxVecWindows + kAvxPostWindows;
+
+// Number of consecutive windows that must reach a threshold to consider the transition complete.
+static constexpr uint32_t kAvxStableWindows = 16;
+
+// Warm-up ends when windows reach 90% of the steady-state, recovery ends when windows reach 97% of the baseline.
+static constexpr double kAvxWarmupThreshold = 0.90;
+static constexpr double kAvxRecoveryThreshold = 0.97;
+
+// Number of runs of each class, the median of each value is reported.
+static constexpr uint32_t kAvxRuns = 5;
+
+static double avx_median(std::vector<double> values) {
+  if (values.empty())
+    return 0.0;
+
+  size_t mid = values.size() / 2;
+  std::nth_element(values.begin(), values.begin() + mid, values.end());
+  return values[mid];
+}
+
+// ============================================================================
+// [cult::AvxFreqBench]
+// ============================================================================
+
+AvxFreqBench::AvxFreqBench(App* app)
+  : BaseBench(app),
+    _isa_class(0),
+    _tsc_freq(app->tsc_freq()) {
+
+  _stamps.resize(kAvxTotalWindows + 1);
+  lock_data(_stamps.data(), _stamps.size() * sizeof(uint64_t));
+}
+
+AvxFreqBench::~AvxFreqBench() {}
+
+uint32_t AvxFreqBench::local_stack_size() const {
+  return 0;
+}
+
+bool AvxFreqBench::can_test(uint32_t isa_class) const {
+  switch (isa_class) {
+    case kClassYmmLight: return x86_features().has_avx2();
+    case kClassYmmHeavy: return x86_features().has_avx() && x86_features().has_fma();
+    case kClassZmmLight:
+    case kClassZmmHeavy: return x86_features().has_avx512_f();
+    default:
+      return false;
+  }
+}
+
+void AvxFreqBench::run() {
+  JSONBuilder& json = _app->json();
+
+  if (_app->verbose())
+    printf("AVX frequency transitions (core/TSC frequency ratio, warm-up and recovery):\n");
+
+  json.before_record()
+      .add_key("avxTransitions")
+      .open_array();
+
+  for (uint32_t isa_class = 0; isa_class < kClassCount; isa_class++) {
+    if (!can_test(isa_class))
+      continue;
+
+    Result result;
+    if (!test_class(result, isa_class))
+      continue;
+
+    double freqRatio = result.baseline_ratio > 0.0 ? result.steady_ratio / result.baseline_ratio : 0.0;
+
+    if (_app->verbose()) {
+      printf("  %-16s: Scalar:%5.3f Vector:%5.3f Freq:%5.3f MinWindow:%5.3f Warmup:%8.1f us Recovery:%8.1f us%s\n",
+        avx_class_inst[isa_class],
+        result.baseline_ratio,
+        result.steady_ratio,
+        freqRatio,
+        result.min_ratio,
+        result.warmup_us,
+        result.recovery_us,
+        result.recovered ? "" : " (not recovered)");
+    }
+
+    json.before_record()
+        .open_object()
+        .add_key("class").add_string(avx_class_name[isa_class])
+        .add_key("inst").add_string(avx_class_inst[isa_class]).align_to(48)
+        .add_key("scalarRatio").add_doublef("%5.3f", result.baseline_ratio)
+        .add_key("vectorRatio").add_doublef("%5.3f", result.steady_ratio)
+        .add_key("freqRatio").add_doublef("%5.3f", freqRatio)
+        .add_key("minWindow").add_doublef("%5.3f", result.min_ratio)
+        .add_key("warmupUs").add_doublef("%8.1f", result.warmup_us)
+        .add_key("recoveryUs").add_doublef("%8.1f", result.recovery_us)
+        .add_key("recovered").add_bool(result.recovered)
+        .close_object();
+  }
+
+  if (_app->verbose())
+    printf("\n");
+
+  json.close_array(true);
+}
+
+bool AvxFreqBench::test_class(Result& result, uint32_t isa_class) {
+  _isa_class = isa_class;
+  result = Result {};
+
+  Func func = compile_func();
+  if (!func) {
+    printf("FAILED to compile function for AVX frequency test\n");
+    return false;
+  }
+
+  uint32_t runCount = _app->_estimate ? 1u : kAvxRuns;
+  std::vector<double> baseline, steady, minimum, warmup, recovery;
+  uint32_t recoveredCount = 0;
+
+  for (uint32_t i = 0; i < runCount; i++) {
+    uint64_t cycles;
+    func(1, &cycles);
+
+    Result r;
+    analyze_run(r);
+
+    baseline.push_back(r.baseline_ratio);
+    steady.push_back(r.steady_ratio);
+    minimum.push_back(r.min_ratio);
+    warmup.push_back(r.warmup_us);
+    recovery.push_back(r.recovery_us);
+    recoveredCount += uint32_t(r.recovered);
+  }
+
+  release_func(func);
+
+  result.baseline_ratio = avx_median(baseline);
+  result.steady_ratio = avx_median(steady);
+  result.min_ratio = avx_median(minimum);
+  result.warmup_us = avx_median(warmup);
+  result.recovery_us = avx_median(recovery);
+  result.recovered = recoveredCount * 2 > runCount;
+  return true;
+}
+
+// Converts timestamps of the last run to core/TSC frequency ratios of windows and finds transitions.
+void AvxFreqBench::analyze_run(Result& result) const {
+  std::vector<double> ratio(kAvxTotalWindows);
+  for (uint32_t i = 0; i < kAvxTotalWindows; i++) {
+    uint64_t ticks = std::max<uint64_t>(_stamps[i + 1] - _stamps[i], 1u);
+    ratio[i] = double(kAvxBlockSize * kAvxBlocksPerWindow) / double(ticks);
+  }
+
+  uint32_t vecBegin = kAvxPreWindows;
+  uint32_t vecEnd = vecBegin + kAvxVecWindows;
+  uint32_t postBegin = vecEnd;
+  uint32_t postEnd = kAvxTotalWindows;
+
+  // Steady states are medians of the second half of a phase, which filters out interrupts.
+  result.baseline_ratio = avx_median(std::vector<double>(ratio.begin() + kAvxPreWindows / 2, ratio.begin() + vecBegin));
+  result.steady_ratio = avx_median(std::vector<double>(ratio.begin() + vecBegin + kAvxVecWindows / 2, ratio.begin() + vecEnd));
+  result.min_ratio = *std::min_element(ratio.begin() + vecBegin, ratio.begin() + vecEnd);
+
+  // Returns the first window, which starts a sequence of stable windows that reach the given threshold.
+  auto stable_from = [&](uint32_t begin, uint32_t end, double threshold) -> uint32_t {
+    uint32_t count = 0;
+    for (uint32_t i = begin; i < end; i++) {
+      count = ratio[i] >= threshold ? count + 1 : 0;
+      if (count == kAvxStableWindows)
+        return i + 1 - kAvxStableWindows;
+    }
+    return end;
+  };
+
+  auto to_us = [&](uint32_t from, uint32_t to) -> double {
+    return _tsc_freq ? double(_stamps[to] - _stamps[from]) * 1e6 / double(_tsc_freq) : 0.0;
+  };
+
+  uint32_t warmupEnd = stable_from(vecBegin, vecEnd, result.steady_ratio * kAvxWarmupThreshold);
+  uint32_t recoveryEnd = stable_from(postBegin, postEnd, result.baseline_ratio * kAvxRecoveryThreshold);
+
+  result.warmup_us = to_us(vecBegin, warmupEnd);
+  result.recovery_us = to_us(postBegin, recoveryEnd);
+  result.recovered = recoveryEnd < postEnd;
+}
+
+void AvxFreqBench::before_body(x86::Assembler& a) {
+  for (uint32_t i = 0; i < 8; i++)
+    a.vxorps(x86::xmm(i), x86::xmm(i), x86::xmm(i));
+}
+
+void AvxFreqBench::compile_body(x86::Assembler& a, x86::Gp reg_cnt) {
+  (void)reg_cnt;
+
+  a.mov(a.zdi(), uintptr_t(_stamps.data()));
+  a.xor_(x86::ecx, x86::ecx);
+
+  a.rdtsc();
+  a.mov(x86::dword_ptr(a.zdi(), 0), x86::eax);
+  a.mov(x86::dword_ptr(a.zdi(), 4), x86::edx);
+  a.add(a.zdi(), 8);
+
+  emit_phase(a, false, kAvxPreWindows);
+  emit_phase(a, true, kAvxVecWindows);
+  emit_phase(a, false, kAvxPostWindows);
+}
+
+void AvxFreqBench::after_body(x86::Assembler& a) {
+  a.vzeroupper();
+}
+
+// Emits windows of blocks, each window stores a timestamp when it ends. Timestamps are not serialized as windows
+// are much longer than the reordering window of the CPU.
+void AvxFreqBench::emit_phase(x86::Assembler& a, bool vector, uint32_t windows) {
+  bool zmm = _isa_class == kClassZmmLight || _isa_class == kClassZmmHeavy;
+  bool heavy = _isa_class == kClassYmmHeavy || _isa_class == kClassZmmHeavy;
+
+  // Registers 0-5 are accumulators, registers 6 and 7 are sources, which works in 32-bit mode as well.
+  auto vec = [&](uint32_t id) -> x86::Vec {
+    return zmm ? x86::Vec(x86::zmm(id)) : x86::Vec(x86::ymm(id));
+  };
+
+  Label L_Window = a.new_label();
+  Label L_Block = a.new_label();
+
+  a.mov(x86::ebx, windows);
+  a.bind(L_Window);
+  a.mov(x86::esi, kAvxBlocksPerWindow);
+
+  a.align(AlignMode::kCode, 64);
+  a.bind(L_Block);
+
+  for (uint32_t i = 0; i < kAvxBlockSize; i++) {
+    if (vector) {
+      x86::Vec acc = vec(i % 6);
+      if (heavy)
+        a.vfmadd231ps(acc, vec(6), vec(7));
+      else
+        a.vpaddd(acc, acc, vec(6));
+    }
+    a.add(x86::ecx, 1);
+  }
+
+  a.sub(x86::esi, 1);
+  a.jnz(L_Block);
+
+  a.rdtsc();
+  a.mov(x86::dword_ptr(a.zdi(), 0), x86::eax);
+  a.mov(x86::dword_ptr(a.zdi(), 4), x86::edx);
+  a.add(a.zdi(), 8);
+
+  a.sub(x86::ebx, 1);
+  a.jnz(L_Window);
+}
+
+} // {cult} namespace
@@ -0,0 +1,67 @@
+#ifndef _CULT_AVXFREQBENCH_H
+#define _CULT_AVXFREQBENCH_H
+
+#include <vector>
+
+#include "basebench.h"
+
+namespace cult {
+
+// ============================================================================
+// [cult::AvxFreqBench]
+// ============================================================================
+
+// Measures transitions between scalar code and code that uses 256-bit and 512-bit vector units.
+//
+// A single run executes a scalar phase, a vector phase, and a scalar phase again. Each phase consists of short
+// windows, which are timestamped by RDTSC. Every block of a window contains a dependent chain of 8 scalar
+// additions, which takes 8 core cycles, so the number of additions per TSC tick is the ratio of the core frequency
+// to the TSC frequency. Blocks of the vector phase also contain 8 independent vector instructions, which don't
+// limit the block while the vector unit runs at full throughput. This makes the slow period after the vector unit
+// is powered up visible as slower windows (warm-up), a lower frequency license as a lower steady-state ratio, and
+// the time to return to the scalar frequency as a recovery delay.
+class AvxFreqBench : public BaseBench {
+public:
+  enum IsaClass : uint32_t {
+    kClassYmmLight,
+    kClassYmmHeavy,
+    kClassZmmLight,
+    kClassZmmHeavy,
+
+    kClassCount
+  };
+
+  struct Result {
+    double baseline_ratio;
+    double steady_ratio;
+    double min_ratio;
+    double warmup_us;
+    double recovery_us;
+    bool recovered;
+  };
+
+  AvxFreqBench(App* app);
+  virtual ~AvxFreqBench();
+
+  bool can_test(uint32_t isa_class) const;
+  bool test_class(Result& result, uint32_t isa_class);
+  void analyze_run(Result& result) const;
+
+  uint32_t local_stack_size() const override;
+  void run() override;
+  void before_body(x86::Assembler& a) override;
+  void compile_body(x86::Assembler& a, x86::Gp reg_cnt) override;
+  void after_body(x86::Assembler& a) override;
+
+  void emit_phase(x86::Assembler& a, bool vector, uint32_t windows);
+
+  uint32_t _isa_class {};
+  uint64_t _tsc_freq {};
+
+  // Timestamps of all windows of a single run preceded by the timestamp of the start.
+  std::vector<uint64_t> _stamps;
+};
+
+} // {cult} namespace
+
+#endif // _CULT_AVXFREQBENCH_H
@@ -1,4 +1,7 @@
 #include "./basebench.h"
+#include "./schedutils.h"
+
+#include <algorithm>
 
 namespace cult {
 
@@ -107,6 +110,11 @@ BaseBench::Func BaseBench::compile_func() {
 
   Func func;
   _runtime.add(&func, &code);
+
+  // Prefault and lock the code so the first calls don't page fault (only a single page in most cases).
+  if (func && _app->isolate())
+    SchedUtils::lock_memory((const void*)func, code.code_size());
+
   return func;
 }
 
@@ -114,4 +122,73 @@ void BaseBench::release_func(Func func) {
   _runtime.release(func);
 }
 
+void BaseBench::lock_data(const void* p, size_t size) {
+  if (p && _app->isolate())
+    SchedUtils::lock_memory(p, size);
+}
+
+uint64_t BaseBench::measure_best(Func func, uint32_t n_iter) {
+  // Consider a significant improvement 0.05 cycles per instruction (0.2 cycles in fast mode).
+  bool estimate = _app->_estimate || _quick;
+  uint32_t kSignificantImprovement = uint32_t(double(n_iter) * (estimate ? 0.25 : 0.04));
+
+  // If we called the function N times without a significant improvement we terminate the test.
+  uint32_t kMaximumImprovementTries = estimate ? 1000 : 50000;
+
+  constexpr uint32_t kMaxIterationCount = 5000000;
+
+  uint64_t best;
+  func(n_iter, &best);
+
+  // Calibrated samples are much longer than samples of a fixed number of iterations of fast code (about 10000
+  // cycles), the number of tries is reduced so the time spent waiting for an improvement stays the same, and the
+  // improvement is relative to the sample.
+  if (_calibrated) {
+    constexpr double kReferenceSampleCycles = 10000.0;
+    double sample = double(std::max<uint64_t>(best, 1u));
+
+    kSignificantImprovement = std::max<uint32_t>(uint32_t(sample * (estimate ? 0.004 : 0.0006)), 1u);
+    kMaximumImprovementTries = uint32_t(std::max<double>(double(kMaximumImprovementTries) * std::min(kReferenceSampleCycles / sample, 1.0),
+                                                         estimate ? 20.0 : 200.0));
+  }
+
+  // Only the first samples are kept for the spread, which is enough for a quartile.
+  constexpr size_t kMaxSpreadSamples = 1024;
+
+  uint64_t previousBest = best;
+  uint32_t improvementTries = 0;
+
+  _samples.clear();
+  _samples.push_back(best);
+
+  for (uint32_t i = 0; i < kMaxIterationCount; i++) {
+    uint64_t n;
+    func(n_iter, &n);
+
+    if (_samples.size() < kMaxSpreadSamples)
+      _samples.push_back(n);
+
+    best = std::min(best, n);
+    if (n < previousBest) {
+      if (previousBest - n >= kSignificantImprovement) {
+        previousBest = n;
+        improvementTries = 0;
+      }
+    }
+    else {
+      improvementTries++;
+    }
+
+    if (improvementTries >= kMaximumImprovementTries)
+      break;
+  }
+
+  // The lower quartile ignores samples disturbed by interrupts, which would dominate the mean.
+  size_t quartile = _samples.size() / 4;
+  std::nth_element(_samples.begin(), _samples.begin() + quartile, _samples.end());
+  _last_spread = double(_samples[quartile] - best);
+
+  return best;
+}
+
 } // {cult} namespace
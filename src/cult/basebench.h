@@ -3,6 +3,8 @@
 
 #include "app.h"
 
+#include <vector>
+
 namespace cult {
 
 class BaseBench {
@@ -17,6 +19,13 @@ public:
   Func compile_func();
   void release_func(Func func);
 
+  // Prefaults and locks a data buffer of the benchmark when running isolated (`--isolate`).
+  void lock_data(const void* p, size_t size);
+
+  // Calls `func` repeatedly until there is no significant improvement and returns the best number of cycles. The
+  // spread of the samples is stored in `_last_spread`.
+  uint64_t measure_best(Func func, uint32_t n_iter);
+
   virtual uint32_t local_stack_size() const = 0;
   virtual void run() = 0;
   virtual void before_body(x86::Assembler& a) = 0;
@@ -25,6 +34,18 @@ public:
 
   App* _app;
 
+  // Use the low precision thresholds of `--estimate` in `measure_best()`.
+  bool _quick = false;
+
+  // Samples are calibrated to take about the same number of cycles, `measure_best()` scales its thresholds by the
+  // size of the first sample instead of the number of iterations.
+  bool _calibrated = false;
+
+  // Difference between the lower quartile and the best sample of the last `measure_best()` call in cycles, which
+  // estimates the noise of the measurement.
+  double _last_spread = 0.0;
+  std::vector<uint64_t> _samples;
+
   JitRuntime _runtime;
   CpuInfo _cpuInfo;
 };
@@ -0,0 +1,98 @@
+#include "clockbench.h"
+
+namespace cult {
+
+// Number of calls of a single measurement, the fastest call is used.
+static constexpr uint32_t kClockCalls = 20;
+
+// ============================================================================
+// [cult::ClockBench]
+// ============================================================================
+
+ClockBench::ClockBench(App* app)
+  : BaseBench(app),
+    _n_iter(1000),
+    _n_unroll(64) {}
+
+ClockBench::~ClockBench() {
+  if (_func)
+    release_func(_func);
+}
+
+uint32_t ClockBench::local_stack_size() const {
+  return 0;
+}
+
+// Returns the core/TSC frequency ratio or zero if the kernel couldn't be compiled.
+double ClockBench::measure_ratio() {
+  if (!_func) {
+    _func = compile_func();
+    if (!_func) {
+      printf("FAILED to compile function for clock test\n");
+      return 0.0;
+    }
+  }
+
+  uint64_t best;
+  _func(_n_iter, &best);
+
+  for (uint32_t i = 1; i < kClockCalls; i++) {
+    uint64_t n;
+    _func(_n_iter, &n);
+    best = std::min(best, n);
+  }
+
+  return best ? double(_n_iter * _n_unroll) / double(best) : 0.0;
+}
+
+void ClockBench::run() {
+  JSONBuilder& json = _app->json();
+
+  uint64_t tscFreq = _app->tsc_freq();
+  double ratio = measure_ratio();
+  double coreFreq = ratio * double(tscFreq);
+
+  if (_app->verbose()) {
+    printf("Clock:\n");
+    printf("  TSC Frequency : %llu\n", (unsigned long long)tscFreq);
+    printf("  Core/TSC Ratio: %5.3f\n", ratio);
+    printf("  Core Frequency: %llu\n", (unsigned long long)coreFreq);
+    printf("\n");
+  }
+
+  json.before_record()
+      .add_key("clock")
+      .open_object()
+        .before_record().add_key("tscFreq").add_uint(tscFreq)
+        .before_record().add_key("coreRatio").add_doublef("%5.3f", ratio)
+        .before_record().add_key("coreFreq").add_uint(uint64_t(coreFreq))
+      .close_object(true);
+}
+
+void ClockBench::before_body(x86::Assembler& a) {
+  a.xor_(x86::esi, x86::esi);
+}
+
+void ClockBench::compile_body(x86::Assembler& a, x86::Gp reg_cnt) {
+  Label L_Body = a.new_label();
+  Label L_End = a.new_label();
+
+  a.test(reg_cnt, reg_cnt);
+  a.jz(L_End);
+
+  a.align(AlignMode::kCode, 64);
+  a.bind(L_Body);
+
+  for (uint32_t n = 0; n < _n_unroll; n++)
+    a.add(x86::esi, 1);
+
+  a.sub(reg_cnt, 1);
+  a.jnz(L_Body);
+  a.bind(L_End);
+}
+
+void ClockBench::after_body(x86::Assembler& a) {
+  (void)a;
+}
+
+} // {cult} namespace
@@ -0,0 +1,37 @@
+#ifndef _CULT_CLOCKBENCH_H
+#define _CULT_CLOCKBENCH_H
+
+#include "basebench.h"
+
+namespace cult {
+
+// ============================================================================
+// [cult::ClockBench]
+// ============================================================================
+
+// Measures the ratio of the core clock to the TSC clock.
+//
+// The kernel is a dependent chain of `add` instructions, which have a latency of one core cycle on all supported
+// CPUs, so the number of additions per TSC tick is the effective core/TSC frequency ratio at the time of the
+// measurement. It's short, so it can be interleaved with other measurements to track frequency changes.
+class ClockBench : public BaseBench {
+public:
+  ClockBench(App* app);
+  virtual ~ClockBench();
+
+  double measure_ratio();
+
+  uint32_t local_stack_size() const override;
+  void run() override;
+  void before_body(x86::Assembler& a) override;
+  void compile_body(x86::Assembler& a, x86::Gp reg_cnt) override;
+  void after_body(x86::Assembler& a) override;
+
+  uint32_t _n_iter {};
+  uint32_t _n_unroll {};
+  Func _func {};
+};
+
+} // {cult} namespace
+
+#endif // _CULT_CLOCKBENCH_H
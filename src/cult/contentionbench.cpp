@@ -0,0 +1,247 @@
+#include "contentionbench.h"
+#include "schedutils.h"
+
+#include <stdlib.h>
+
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+namespace cult {
+
+static const char* contention_op_name[ContentionBench::kOpCount] = {
+  "lock add [m], r32",
+  "lock xadd [m], r32",
+  "lock cmpxchg [m], r32",
+  "xchg [m], r32"
+};
+
+static const char* contention_target_name[ContentionBench::kTargetCount] = {
+  "shared",
+  "private"
+};
+
+// Private lines are 128 bytes apart so the adjacent line prefetcher doesn't pair lines of different threads.
+static constexpr uint32_t kContentionLineStride = 128;
+
+// Number of times each configuration is executed, the fastest run is reported.
+static constexpr uint32_t kContentionRuns = 5;
+
+struct ContentionThread {
+  BaseBench::Func func;
+  uint32_t cpu;
+  uint32_t n_iter;
+  uint64_t cycles;
+  bool pinned;
+  std::chrono::steady_clock::time_point start;
+  std::chrono::steady_clock::time_point end;
+};
+
+// All threads wait until every thread is running on its CPU, so the measured intervals overlap.
+// A thread that couldn't be pinned still runs so the other threads are not blocked, the result is discarded.
+static void contention_thread_main(ContentionThread* t, std::atomic<uint32_t>* arrived, uint32_t thread_count) {
+  t->pinned = SchedUtils::set_affinity(t->cpu);
+
+  uint64_t warmup;
+  t->func(1, &warmup);
+
+  arrived->fetch_add(1);
+  while (arrived->load() < thread_count)
+    continue;
+
+  t->start = std::chrono::steady_clock::now();
+  t->func(t->n_iter, &t->cycles);
+  t->end = std::chrono::steady_clock::now();
+}
+
+// ============================================================================
+// [cult::ContentionBench]
+// ============================================================================
+
+ContentionBench::ContentionBench(App* app)
+  : BaseBench(app),
+    _op(0),
+    _address(nullptr),
+    _n_iter(2000),
+    _n_unroll(64) {
+
+  // Affinity masks are 64-bit on Windows.
+  _cpus = SchedUtils::allowed_cpus();
+  if (_cpus.size() > 64u)
+    _cpus.resize(64u);
+  _max_threads = uint32_t(_cpus.size());
+
+  // The first line is shared by all threads, the remaining lines are private.
+  _data = calloc(1, size_t(_max_threads + 1) * kContentionLineStride + 64);
+  lock_data(_data, size_t(_max_threads + 1) * kContentionLineStride + 64);
+  _aligned_data = reinterpret_cast<uint8_t*>((uintptr_t(_data) + 63u) & ~uintptr_t(63u));
+}
+
+ContentionBench::~ContentionBench() {
+  free(_data);
+}
+
+uint32_t ContentionBench::local_stack_size() const {
+  return 0;
+}
+
+uint8_t* ContentionBench::line_of(uint32_t target, uint32_t thread_index) const {
+  uint32_t index = target == kTargetShared ? 0u : thread_index + 1u;
+  return _aligned_data + size_t(index) * kContentionLineStride;
+}
+
+void ContentionBench::run() {
+  JSONBuilder& json = _app->json();
+
+  std::vector<uint32_t> thread_counts;
+  for (uint32_t n = 1; n < _max_threads; n *= 2)
+    thread_counts.push_back(n);
+  thread_counts.push_back(_max_threads);
+
+  if (_app->verbose())
+    printf("Atomic contention (aggregate throughput and cycles per operation in each thread):\n");
+
+  json.before_record()
+      .add_key("lockContention")
+      .open_array();
+
+  for (uint32_t op = 0; op < kOpCount; op++) {
+    for (uint32_t target = 0; target < kTargetCount; target++) {
+      for (uint32_t thread_count : thread_counts) {
+        Result result;
+        if (!test_threads(result, op, target, thread_count))
+          continue;
+
+        double mops = result.ops_per_sec / 1e6;
+
+        if (_app->verbose()) {
+          printf("  %-24s %-7s Threads:%-3u: MOps/s:%9.2f Cycles:%7.2f\n",
+            contention_op_name[op], contention_target_name[target], thread_count, mops, result.cycles_per_op);
+        }
+
+        json.before_record()
+            .open_object()
+            .add_key("inst").add_string(contention_op_name[op]).align_to(40)
+            .add_key("target").add_string(contention_target_name[target])
+            .add_key("threads").add_uint(thread_count)
+            .add_key("mops").add_doublef("%9.2f", mops)
+            .add_key("cycles").add_doublef("%7.2f", result.cycles_per_op)
+            .close_object();
+      }
+    }
+  }
+
+  if (_app->verbose())
+    printf("\n");
+
+  json.close_array(true);
+}
+
+bool ContentionBench::test_threads(Result& result, uint32_t op, uint32_t target, uint32_t thread_count) {
+  result = Result {};
+  std::vector<ContentionThread> threads(thread_count);
+
+  // Functions are compiled upfront as each thread uses a different address in private mode.
+  _op = op;
+  for (uint32_t i = 0; i < thread_count; i++) {
+    _address = line_of(target, i);
+
+    threads[i].func = compile_func();
+    threads[i].cpu = _cpus[i];
+    threads[i].n_iter = _n_iter;
+
+    if (!threads[i].func) {
+      printf("FAILED to compile function for '%s'\n", contention_op_name[op]);
+      for (uint32_t j = 0; j < i; j++)
+        release_func(threads[j].func);
+      return false;
+    }
+  }
+
+  double total_ops = double(thread_count) * double(_n_iter) * double(_n_unroll);
+
+  for (uint32_t r = 0; r < kContentionRuns; r++) {
+    std::atomic<uint32_t> arrived(0);
+    std::vector<std::thread> workers;
+
+    for (uint32_t i = 0; i < thread_count; i++)
+      workers.emplace_back(contention_thread_main, &threads[i], &arrived, thread_count);
+
+    for (std::thread& worker : workers)
+      worker.join();
+
+    for (const ContentionThread& t : threads) {
+      if (!t.pinned) {
+        printf("FAILED to pin thread to CPU %u\n", t.cpu);
+        for (const ContentionThread& f : threads)
+          release_func(f.func);
+        return false;
+      }
+    }
+
+    auto start = threads[0].start;
+    auto end = threads[0].end;
+    uint64_t cycles = 0;
+
+    for (const ContentionThread& t : threads) {
+      start = std::min(start, t.start);
+      end = std::max(end, t.end);
+      cycles += t.cycles;
+    }
+
+    double seconds = std::chrono::duration<double>(end - start).count();
+    double ops_per_sec = seconds > 0.0 ? total_ops / seconds : 0.0;
+
+    if (ops_per_sec > result.ops_per_sec) {
+      result.ops_per_sec = ops_per_sec;
+      result.cycles_per_op = double(cycles) / total_ops;
+    }
+  }
+
+  for (const ContentionThread& t : threads)
+    release_func(t.func);
+
+  return true;
+}
+
+void ContentionBench::before_body(x86::Assembler& a) {
+  (void)a;
+}
+
+void ContentionBench::compile_body(x86::Assembler& a, x86::Gp reg_cnt) {
+  x86::Gp address = a.zsi();
+  x86::Mem m = x86::dword_ptr(address);
+
+  a.mov(address, uintptr_t(_address));
+  a.mov(x86::eax, 1);
+  a.mov(x86::ecx, 1);
+
+  Label L_Body = a.new_label();
+  Label L_End = a.new_label();
+
+  a.test(reg_cnt, reg_cnt);
+  a.jz(L_End);
+
+  a.align(AlignMode::kCode, 64);
+  a.bind(L_Body);
+
+  for (uint32_t n = 0; n < _n_unroll; n++) {
+    switch (_op) {
+      case kOpLockAdd    : a.lock().add(m, x86::ecx); break;
+      case kOpLockXadd   : a.lock().xadd(m, x86::ecx); break;
+      case kOpLockCmpxchg: a.lock().cmpxchg(m, x86::ecx, x86::eax); break;
+      case kOpXchg       : a.xchg(m, x86::ecx); break;
+    }
+  }
+
+  a.sub(reg_cnt, 1);
+  a.jnz(L_Body);
+  a.bind(L_End);
+}
+
+void ContentionBench::after_body(x86::Assembler& a) {
+  (void)a;
+}
+
+} // {cult} namespace
@@ -0,0 +1,72 @@
+#ifndef _CULT_CONTENTIONBENCH_H
+#define _CULT_CONTENTIONBENCH_H
+
+#include "basebench.h"
+
+#include <vector>
+
+namespace cult {
+
+// ============================================================================
+// [cult::ContentionBench]
+// ============================================================================
+
+// Measures how atomic read-modify-write instructions scale with the number of threads.
+//
+// Each thread is pinned to its own CPU and executes a stream of atomic operations. Either all threads access the
+// same cache line, which has to move between cores after each operation, or each thread accesses its own line,
+// which shows whether the instruction itself limits the throughput. The aggregate throughput is computed from the
+// wall time of all threads, the latency is the average number of cycles of a single operation in each thread.
+class ContentionBench : public BaseBench {
+public:
+  enum Op : uint32_t {
+    kOpLockAdd,
+    kOpLockXadd,
+    kOpLockCmpxchg,
+    kOpXchg,
+
+    kOpCount
+  };
+
+  enum Target : uint32_t {
+    kTargetShared,
+    kTargetPrivate,
+
+    kTargetCount
+  };
+
+  struct Result {
+    double ops_per_sec;
+    double cycles_per_op;
+  };
+
+  ContentionBench(App* app);
+  virtual ~ContentionBench();
+
+  inline bool is_64bit() const {
+    return Environment::is_64bit(Arch::kHost);
+  }
+
+  uint8_t* line_of(uint32_t target, uint32_t thread_index) const;
+  bool test_threads(Result& result, uint32_t op, uint32_t target, uint32_t thread_count);
+
+  uint32_t local_stack_size() const override;
+  void run() override;
+  void before_body(x86::Assembler& a) override;
+  void compile_body(x86::Assembler& a, x86::Gp reg_cnt) override;
+  void after_body(x86::Assembler& a) override;
+
+  uint32_t _op {};
+  uint8_t* _address {};
+  uint32_t _n_iter {};
+  uint32_t _n_unroll {};
+
+  std::vector<uint32_t> _cpus;
+  uint32_t _max_threads {};
+  void* _data {};
+  uint8_t* _aligned_data {};
+};
+
+} // {cult} namespace
+
+#endif // _CULT_CONTENTIONBENCH_H
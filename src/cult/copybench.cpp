@@ -0,0 +1,400 @@
+#include "copybench.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <vector>
+
+namespace cult {
+
+static const char* copy_op_name[CopyBench::kOpCount] = {
+  "copy",
+  "fill"
+};
+
+static const char* copy_strategy_name[CopyBench::kStrategyCount] = {
+  "rep",
+  "gp",
+  "sse",
+  "avx",
+  "avx512",
+  "nt"
+};
+
+// Misaligned tests move the source by 3 bytes and the destination by 1 byte, so they are never mutually aligned.
+static constexpr uint32_t kCopySrcMisalignment = 3;
+static constexpr uint32_t kCopyDstMisalignment = 1;
+
+// Non-temporal stores only pay off for large buffers, smaller sizes are not tested.
+static constexpr uint32_t kCopyNtMinSize = 256;
+
+// Number of bytes processed by a single call of a small test and by all runs of a test.
+static constexpr uint32_t kCopyBytesPerCall = 256u * 1024u;
+static constexpr uint64_t kCopyBytesPerTest = 256u * 1024u * 1024u;
+
+// Calls a copy function and returns the best number of cycles. Sizes vary from 1 byte to tens of megabytes, so the
+// number of runs depends on the size instead of waiting for no improvement as `measure_best()` does.
+static uint64_t copy_measure(BaseBench::Func func, uint32_t n_iter, uint32_t runs) {
+  uint64_t best;
+  func(n_iter, &best);
+
+  for (uint32_t i = 0; i < runs; i++) {
+    uint64_t n;
+    func(n_iter, &n);
+    best = std::min(best, n);
+  }
+
+  return best;
+}
+
+// ============================================================================
+// [cult::CopyBench]
+// ============================================================================
+
+CopyBench::CopyBench(App* app)
+  : BaseBench(app),
+    _op(0),
+    _strategy(0),
+    _size(0),
+    _aligned(true) {
+
+  _max_size = 64u * 1024u * 1024u;
+
+  // Buffers are page aligned and initialized so they're not backed by a shared zero page.
+  _src_data = malloc(_max_size + 8192);
+  _dst_data = malloc(_max_size + 8192);
+
+  _src = reinterpret_cast<uint8_t*>((uintptr_t(_src_data) + 4095u) & ~uintptr_t(4095u));
+  _dst = reinterpret_cast<uint8_t*>((uintptr_t(_dst_data) + 4095u) & ~uintptr_t(4095u));
+
+  memset(_src, 1, _max_size + 4096);
+  memset(_dst, 2, _max_size + 4096);
+
+  lock_data(_src_data, _max_size + 8192);
+  lock_data(_dst_data, _max_size + 8192);
+}
+
+CopyBench::~CopyBench() {
+  free(_src_data);
+  free(_dst_data);
+}
+
+uint32_t CopyBench::local_stack_size() const {
+  return 0;
+}
+
+uint32_t CopyBench::strategy_width(uint32_t strategy) const {
+  switch (strategy) {
+    case kStrategyGp    : return is_64bit() ? 8u : 4u;
+    case kStrategySse   : return 16;
+    case kStrategyAvx   : return 32;
+    case kStrategyAvx512: return 64;
+
+    // Non-temporal stores use the widest vector registers available.
+    case kStrategyNt:
+      return x86_features().has_avx512_f() ? 64u : x86_features().has_avx() ? 32u : 16u;
+
+    default:
+      return 1;
+  }
+}
+
+bool CopyBench::can_test(uint32_t strategy, uint32_t size, bool aligned) const {
+  switch (strategy) {
+    case kStrategySse:
+      return x86_features().has_sse2();
+
+    case kStrategyAvx:
+      return x86_features().has_avx();
+
+    case kStrategyAvx512:
+      return x86_features().has_avx512_f();
+
+    // Non-temporal vector stores require aligned memory.
+    case kStrategyNt:
+      return x86_features().has_sse2() && aligned && size >= kCopyNtMinSize;
+
+    default:
+      return true;
+  }
+}
+
+void CopyBench::run() {
+  JSONBuilder& json = _app->json();
+
+  struct Winner {
+    uint32_t op;
+    bool aligned;
+    uint32_t size;
+    uint32_t strategy;
+    double cycles;
+  };
+
+  std::vector<Winner> winners;
+
+  if (_app->verbose())
+    printf("Copy & fill strategies (cycles per call):\n");
+
+  json.before_record()
+      .add_key("copyStrategies")
+      .open_array();
+
+  for (uint32_t op = 0; op < kOpCount; op++) {
+    for (uint32_t a = 0; a < 2; a++) {
+      bool aligned = a == 0;
+
+      for (uint32_t size = 1; size <= _max_size; size *= 2) {
+        Winner winner { op, aligned, size, 0, 0.0 };
+        bool hasWinner = false;
+        StringTmp<256> sb;
+
+        for (uint32_t strategy = 0; strategy < kStrategyCount; strategy++) {
+          if (!can_test(strategy, size, aligned))
+            continue;
+
+          // Strategies that failed to compile are neither reported nor considered a winner.
+          double cycles = test_strategy(op, strategy, size, aligned);
+          if (cycles < 0.0)
+            continue;
+
+          double bytesPerCycle = cycles > 0.0 ? double(size) / cycles : 0.0;
+
+          if (!hasWinner || cycles < winner.cycles) {
+            winner.strategy = strategy;
+            winner.cycles = cycles;
+            hasWinner = true;
+          }
+
+          sb.append_format(" %s:%.2f", copy_strategy_name[strategy], cycles);
+
+          json.before_record()
+              .open_object()
+              .add_key("op").add_string(copy_op_name[op])
+              .add_key("aligned").add_bool(aligned)
+              .add_key("size").add_uint(size).align_to(48)
+              .add_key("strategy").add_string(copy_strategy_name[strategy]).align_to(72)
+              .add_key("cycles").add_doublef("%10.2f", cycles)
+              .add_key("bytesPerCycle").add_doublef("%7.2f", bytesPerCycle)
+              .close_object();
+        }
+
+        if (!hasWinner)
+          continue;
+
+        if (_app->verbose()) {
+          printf("  %s %-10s Size:%-9u: Winner:%-6s%s\n",
+            copy_op_name[op], aligned ? "aligned" : "misaligned", size, copy_strategy_name[winner.strategy], sb.data());
+        }
+
+        winners.push_back(winner);
+      }
+    }
+  }
+
+  json.close_array(true);
+
+  json.before_record()
+      .add_key("copyWinners")
+      .open_array();
+
+  for (const Winner& winner : winners) {
+    json.before_record()
+        .open_object()
+        .add_key("op").add_string(copy_op_name[winner.op])
+        .add_key("aligned").add_bool(winner.aligned)
+        .add_key("size").add_uint(winner.size).align_to(48)
+        .add_key("winner").add_string(copy_strategy_name[winner.strategy]).align_to(72)
+        .add_key("cycles").add_doublef("%10.2f", winner.cycles)
+        .close_object();
+  }
+
+  if (_app->verbose())
+    printf("\n");
+
+  json.close_array(true);
+}
+
+double CopyBench::test_strategy(uint32_t op, uint32_t strategy, uint32_t size, bool aligned) {
+  _op = op;
+  _strategy = strategy;
+  _size = size;
+  _aligned = aligned;
+
+  Func func = compile_func();
+  if (!func) {
+    printf("FAILED to compile function for '%s' %s strategy\n", copy_strategy_name[strategy], copy_op_name[op]);
+    return -1.0;
+  }
+
+  uint32_t nIter = std::max<uint32_t>(kCopyBytesPerCall / size, 1u);
+  uint32_t runs = uint32_t(std::min<uint64_t>(std::max<uint64_t>(kCopyBytesPerTest / (uint64_t(size) * nIter), 3u), 100u));
+  uint64_t best = copy_measure(func, nIter, runs);
+
+  release_func(func);
+  return double(best) / double(nIter);
+}
+
+void CopyBench::before_body(x86::Assembler& a) {
+  if (_op != kOpFill)
+    return;
+
+  // Fill uses all bits set, which is the easiest value to materialize in all register kinds. EAX is clobbered by
+  // the timing prolog, so the value of `rep stos` is set in `compile_body()`.
+  switch (_strategy) {
+    case kStrategyRep:
+      break;
+
+    case kStrategyGp:
+      a.mov(a.zbx(), -1);
+      break;
+
+    default:
+      a.mov(a.zbx(), -1);
+      if (strategy_width(_strategy) == 64)
+        a.vpternlogd(x86::zmm7, x86::zmm7, x86::zmm7, 0xFF);
+      else if (strategy_width(_strategy) == 32)
+        a.vpcmpeqd(x86::ymm7, x86::ymm7, x86::ymm7);
+      else
+        a.pcmpeqd(x86::xmm7, x86::xmm7);
+      break;
+  }
+}
+
+void CopyBench::compile_body(x86::Assembler& a, x86::Gp reg_cnt) {
+  x86::Gp src = a.zsi();
+  x86::Gp dst = a.zdi();
+  x86::Gp cnt = a.zcx();
+
+  uint8_t* srcData = _src + (_aligned ? 0u : kCopySrcMisalignment);
+  uint8_t* dstData = _dst + (_aligned ? 0u : kCopyDstMisalignment);
+
+  bool is_copy = _op == kOpCopy;
+  bool is_nt = _strategy == kStrategyNt;
+
+  Label L_Body = a.new_label();
+  Label L_End = a.new_label();
+
+  a.test(reg_cnt, reg_cnt);
+  a.jz(L_End);
+
+  a.align(AlignMode::kCode, 64);
+  a.bind(L_Body);
+
+  if (is_copy)
+    a.mov(src, uintptr_t(srcData));
+  a.mov(dst, uintptr_t(dstData));
+
+  if (_strategy == kStrategyRep) {
+    a.mov(cnt, _size);
+
+    if (is_copy) {
+      a.rep(cnt).movs(x86::byte_ptr(dst), x86::byte_ptr(src));
+    }
+    else {
+      a.mov(x86::eax, -1);
+      a.rep(cnt).stos(x86::byte_ptr(dst), x86::al);
+    }
+  }
+  else {
+    uint32_t width = strategy_width(_strategy);
+    uint32_t block = width * 4;
+
+    if (_size >= block) {
+      Label L_Loop = a.new_label();
+
+      a.mov(cnt, _size / block);
+      a.bind(L_Loop);
+
+      for (uint32_t k = 0; k < 4; k++)
+        emit_chunk(a, width, int32_t(k * width), k, is_nt);
+
+      if (is_copy)
+        a.add(src, block);
+      a.add(dst, block);
+      a.sub(cnt, 1);
+      a.jnz(L_Loop);
+    }
+
+    // The remaining bytes are known at compile time, they are moved by decreasing chunk sizes.
+    uint32_t remaining = _size % block;
+    uint32_t offset = 0;
+
+    for (uint32_t chunk = width; chunk; chunk /= 2) {
+      // 32-bit mode has no 8-byte GP register.
+      if (chunk > a.register_size() && chunk < 16)
+        continue;
+
+      while (remaining >= chunk) {
+        emit_chunk(a, chunk, int32_t(offset), 0, false);
+        offset += chunk;
+        remaining -= chunk;
+      }
+    }
+
+    if (is_nt)
+      a.sfence();
+  }
+
+  a.sub(reg_cnt, 1);
+  a.jnz(L_Body);
+  a.bind(L_End);
+}
+
+void CopyBench::after_body(x86::Assembler& a) {
+  if (x86_features().has_avx())
+    a.vzeroupper();
+}
+
+void CopyBench::emit_chunk(x86::Assembler& a, uint32_t width, int32_t offset, uint32_t index, bool nt) {
+  x86::Mem srcMem = x86::ptr(a.zsi(), offset, width);
+  x86::Mem dstMem = x86::ptr(a.zdi(), offset, width);
+  bool is_copy = _op == kOpCopy;
+
+  if (width <= a.register_size()) {
+    x86::Gp r = is_copy ? x86::gpq((index & 1) ? x86::Gp::kIdDx : x86::Gp::kIdAx) : x86::gpq(x86::Gp::kIdBx);
+
+    switch (width) {
+      case 1: r = r.r8(); break;
+      case 2: r = r.r16(); break;
+      case 4: r = r.r32(); break;
+    }
+
+    if (is_copy)
+      a.mov(r, srcMem);
+    a.mov(dstMem, r);
+    return;
+  }
+
+  // SSE strategy uses legacy encoding, the others use VEX/EVEX encoding to avoid SSE/AVX transitions.
+  bool vex = _strategy != kStrategySse && x86_features().has_avx();
+  x86::Vec v = width == 16 ? x86::xmm(index) : width == 32 ? x86::ymm(index) : x86::zmm(index);
+
+  if (is_copy) {
+    if (width == 64)
+      a.vmovdqu32(v, srcMem);
+    else if (vex)
+      a.vmovdqu(v, srcMem);
+    else
+      a.movdqu(v, srcMem);
+  }
+  else {
+    v.set_id(7);
+  }
+
+  if (nt) {
+    if (vex)
+      a.vmovntdq(dstMem, v);
+    else
+      a.movntdq(dstMem, v);
+  }
+  else {
+    if (width == 64)
+      a.vmovdqu32(dstMem, v);
+    else if (vex)
+      a.vmovdqu(dstMem, v);
+    else
+      a.movdqu(dstMem, v);
+  }
+}
+
+} // {cult} namespace
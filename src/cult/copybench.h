@@ -0,0 +1,71 @@
+#ifndef _CULT_COPYBENCH_H
+#define _CULT_COPYBENCH_H
+
+#include "basebench.h"
+
+namespace cult {
+
+// ============================================================================
+// [cult::CopyBench]
+// ============================================================================
+
+// Compares memory copy and fill strategies depending on the size and alignment of the buffers.
+//
+// Each strategy is compiled for a fixed size, which is known at compile time, as it would be in a specialized
+// memcpy/memset path: REP MOVSB/STOSB, a loop of GP moves, a loop of SSE, AVX, or AVX-512 moves, and a loop of
+// non-temporal stores. Loops are unrolled 4 times and the remaining bytes are handled by smaller moves. The fastest
+// strategy of each size is reported as a winner, so a runtime can use the table to dispatch its copy and fill.
+class CopyBench : public BaseBench {
+public:
+  enum Op : uint32_t {
+    kOpCopy,
+    kOpFill,
+
+    kOpCount
+  };
+
+  enum Strategy : uint32_t {
+    kStrategyRep,
+    kStrategyGp,
+    kStrategySse,
+    kStrategyAvx,
+    kStrategyAvx512,
+    kStrategyNt,
+
+    kStrategyCount
+  };
+
+  CopyBench(App* app);
+  virtual ~CopyBench();
+
+  inline bool is_64bit() const {
+    return Environment::is_64bit(Arch::kHost);
+  }
+
+  bool can_test(uint32_t strategy, uint32_t size, bool aligned) const;
+  uint32_t strategy_width(uint32_t strategy) const;
+  double test_strategy(uint32_t op, uint32_t strategy, uint32_t size, bool aligned);
+
+  uint32_t local_stack_size() const override;
+  void run() override;
+  void before_body(x86::Assembler& a) override;
+  void compile_body(x86::Assembler& a, x86::Gp reg_cnt) override;
+  void after_body(x86::Assembler& a) override;
+
+  void emit_chunk(x86::Assembler& a, uint32_t width, int32_t offset, uint32_t index, bool nt);
+
+  uint32_t _op {};
+  uint32_t _strategy {};
+  uint32_t _size {};
+  bool _aligned {};
+
+  uint32_t _max_size {};
+  void* _src_data {};
+  void* _dst_data {};
+  uint8_t* _src {};
+  uint8_t* _dst {};
+};
+
+} // {cult} namespace
+
+#endif // _CULT_COPYBENCH_H
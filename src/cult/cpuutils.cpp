@@ -6,11 +6,8 @@
   #include <x86intrin.h>
 #endif
 
-#if defined(__linux__)
-  #include <time.h>
-#endif
-
 #include <algorithm>
+#include <chrono>
 #include <numeric>
 
 namespace cult {
@@ -46,7 +43,8 @@ static uint64_t get_tsc_freq_via_cpuid() {
   if (out.eax < 0x15u)
     return 0;
 
-  // Determine the base frequency by CPUID.0x15 query.
+  // Determine the base frequency by CPUID.0x15 query. CPUs that don't report the crystal clock frequency are
+  // calibrated, a table of crystal clocks by CPU model would only cover a few models.
   CpuidOut _15;
   cpuid_query(&_15, 0x15u);
   if (_15.ecx) {
@@ -55,32 +53,12 @@ static uint64_t get_tsc_freq_via_cpuid() {
     return uint64_t(_15.ecx) * _15.ebx / _15.eax;
   }
 
-  // Determine the base frequency by CPU family & model ids.
-  // (Intel Manual Volume 3 - Determining the Processor Base Frequency, Section 18.18.3)
-  cpuid_query(&out, 0x1u);
-
-  uint32_t family = (out.eax >> 8) & 0xF;
-  uint32_t model = (out.eax >> 8) & 0xF;
-
-  if (family == 15)
-    family += (out.eax >> 20) & 0xFF;
-
-  if (family == 15 || family == 6)
-    model += ((out.eax >> 16) & 0xF) << 4;
-
-  // 24 MHz crystal clock (Skylake or Kabylake).
-  if (family == 6 && (model == 0x4E || model == 0x5E || model == 0x8E || model == 0x9E))
-    return (int64_t)24000000 * _15.ebx / _15.eax;
-
   return 0;
 }
 
 // Copy of the calibration code from tsc-support.cpp (https://github.com/travisdowns/avx-turbo).
-#if defined(__linux__)
 static inline uint64_t get_clock_monotonic() {
-  struct timespec ts;
-  clock_gettime(CLOCK_MONOTONIC, &ts);
-  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+  return uint64_t(std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now().time_since_epoch()).count());
 }
 
 static uint64_t tsc_calibration_sample() {
@@ -124,14 +102,9 @@ static uint64_t get_tsc_freq_via_calibration() {
   uint64_t sum = std::accumulate(&samples[kThirdQuantile], &samples[kThirdQuantile + kSampleCountDiv5], uint64_t(0));
   return sum / kSampleCountDiv5;
 }
-#endif
 
 uint64_t get_tsc_freq_always_calibrated() {
-#if defined(__linux__)
   return get_tsc_freq_via_calibration();
-#else
-  return 0;
-#endif
 }
 
 uint64_t get_tsc_freq() {
@@ -145,5 +118,52 @@ uint64_t get_tsc_freq() {
   }
 }
 
+// Both Intel (CPUID.4) and AMD (CPUID.8000001D) use the same layout of deterministic cache parameters.
+static uint32_t get_cache_size_via_leaf(uint32_t leaf, uint32_t level) {
+  for (uint32_t subleaf = 0; subleaf < 16; subleaf++) {
+    CpuidOut out;
+    cpuid_query(&out, leaf, subleaf);
+
+    // Cache type 0 means no more caches, 2 is an instruction cache.
+    uint32_t type = out.eax & 0x1Fu;
+    if (type == 0)
+      break;
+
+    if (type == 2 || ((out.eax >> 5) & 0x7u) != level)
+      continue;
+
+    uint32_t ways = ((out.ebx >> 22) & 0x3FFu) + 1;
+    uint32_t partitions = ((out.ebx >> 12) & 0x3FFu) + 1;
+    uint32_t line_size = (out.ebx & 0xFFFu) + 1;
+    uint32_t sets = out.ecx + 1;
+
+    return ways * partitions * line_size * sets;
+  }
+
+  return 0;
+}
+
+uint32_t get_cache_size(uint32_t level) {
+  CpuidOut out;
+  cpuid_query(&out, 0x0u);
+
+  uint32_t max_leaf = out.eax;
+  bool is_amd = out.ebx == 0x68747541u; // "Auth" of "AuthenticAMD".
+
+  if (!is_amd && max_leaf >= 0x4u)
+    return get_cache_size_via_leaf(0x4u, level);
+
+  cpuid_query(&out, 0x80000000u);
+  if (out.eax >= 0x8000001Du) {
+    // TOPOEXT is required for CPUID.8000001D.
+    CpuidOut ext;
+    cpuid_query(&ext, 0x80000001u);
+    if (ext.ecx & (1u << 22))
+      return get_cache_size_via_leaf(0x8000001Du, level);
+  }
+
+  return 0;
+}
+
 } // CpuUtils namespace
 } // {cult} namespace
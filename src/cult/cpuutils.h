@@ -27,6 +27,9 @@ void cpuid_query(CpuidOut* result, uint32_t in_eax, uint32_t in_ecx = 0);
 uint64_t get_tsc_freq();
 uint64_t get_tsc_freq_always_calibrated();
 
+// Returns the size of a data or unified cache of the given `level` (1 to 3) in bytes or zero if unknown.
+uint32_t get_cache_size(uint32_t level);
+
 } // CpuUtils namespace
 } // {cult} namespace
 
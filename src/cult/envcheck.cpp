@@ -0,0 +1,183 @@
+#include "envcheck.h"
+#include "schedutils.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#if defined(__linux__)
+  #include <sys/utsname.h>
+#endif
+
+namespace cult {
+
+// Background load (1 minute average) that is considered noisy.
+static constexpr double kEnvMaxLoadAvg = 1.0;
+
+// Reads the first line of a file without the trailing newline, returns false if the file cannot be read.
+static bool env_read_line(const char* path, char* dst, size_t size) {
+  FILE* f = fopen(path, "rb");
+  if (!f)
+    return false;
+
+  bool ok = fgets(dst, int(size), f) != nullptr;
+  fclose(f);
+
+  if (!ok)
+    return false;
+
+  size_t len = strlen(dst);
+  while (len && (dst[len - 1] == '\n' || dst[len - 1] == ' '))
+    dst[--len] = '\0';
+  return len != 0;
+}
+
+static void env_set(char* dst, size_t size, const char* src) {
+  snprintf(dst, size, "%s", src);
+}
+
+// ============================================================================
+// [cult::EnvCheck]
+// ============================================================================
+
+EnvCheck::EnvCheck(App* app) : _app(app) {
+  env_set(_kernel, sizeof(_kernel), "unknown");
+  env_set(_microcode, sizeof(_microcode), "unknown");
+  env_set(_governor, sizeof(_governor), "unknown");
+  env_set(_scaling_driver, sizeof(_scaling_driver), "unknown");
+  env_set(_turbo, sizeof(_turbo), "unknown");
+  env_set(_smt, sizeof(_smt), "unknown");
+
+  _load_avg[0] = 0.0;
+  _load_avg[1] = 0.0;
+  _load_avg[2] = 0.0;
+  _has_load_avg = false;
+}
+EnvCheck::~EnvCheck() {}
+
+bool EnvCheck::run() {
+  _queryEnvironment();
+  _checkEnvironment();
+
+  if (_app->verbose()) {
+    printf("RunEnvironment:\n");
+    printf("  Kernel: %s\n", _kernel);
+    printf("  Microcode: %s\n", _microcode);
+    printf("  Governor: %s\n", _governor);
+    printf("  ScalingDriver: %s\n", _scaling_driver);
+    printf("  Turbo: %s\n", _turbo);
+    printf("  SMT: %s\n", _smt);
+    if (_has_load_avg)
+      printf("  LoadAvg: %.2f %.2f %.2f\n", _load_avg[0], _load_avg[1], _load_avg[2]);
+    printf("\n");
+  }
+
+  // Warnings are printed even in quiet mode as the JSON alone doesn't tell the user why it may be noisy.
+  for (const char* warning : _warnings)
+    fprintf(stderr, "WARNING: %s\n", warning);
+
+  JSONBuilder& json = _app->json();
+  json.before_record()
+      .add_key("runEnvironment")
+      .open_object()
+        .before_record().add_key("kernel").add_string(_kernel)
+        .before_record().add_key("microcode").add_string(_microcode)
+        .before_record().add_key("governor").add_string(_governor)
+        .before_record().add_key("scalingDriver").add_string(_scaling_driver)
+        .before_record().add_key("turbo").add_string(_turbo)
+        .before_record().add_key("smt").add_string(_smt);
+
+  if (_has_load_avg) {
+    json.before_record().add_key("loadAvg").open_array()
+          .add_doublef("%.2f", _load_avg[0])
+          .add_doublef("%.2f", _load_avg[1])
+          .add_doublef("%.2f", _load_avg[2])
+        .close_array();
+  }
+
+  json.before_record().add_key("noisy").add_bool(!_warnings.empty())
+      .before_record().add_key("warnings").open_array();
+
+  for (const char* warning : _warnings)
+    json.add_string(warning);
+
+  json.close_array()
+      .close_object(true);
+
+  if (_app->strict_env() && !_warnings.empty()) {
+    fprintf(stderr, "The environment is noisy, refusing to run (--strict-env)\n");
+    return false;
+  }
+
+  return true;
+}
+
+void EnvCheck::_queryEnvironment() {
+#if defined(__linux__)
+  struct utsname name;
+  if (uname(&name) == 0)
+    snprintf(_kernel, sizeof(_kernel), "%s %s", name.sysname, name.release);
+
+  // Microcode revision of the first CPU, all CPUs are expected to use the same revision.
+  FILE* f = fopen("/proc/cpuinfo", "rb");
+  if (f) {
+    char line[256];
+    while (fgets(line, sizeof(line), f)) {
+      char value[32];
+      if (sscanf(line, "microcode : %31s", value) == 1) {
+        env_set(_microcode, sizeof(_microcode), value);
+        break;
+      }
+    }
+    fclose(f);
+  }
+
+  // The governor is reported for all CPUs if they all use the same one.
+  uint32_t cpuCount = SchedUtils::cpu_count();
+  for (uint32_t cpu = 0; cpu < cpuCount; cpu++) {
+    char path[128];
+    char value[32];
+
+    snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%u/cpufreq/scaling_governor", cpu);
+    if (!env_read_line(path, value, sizeof(value)))
+      continue;
+
+    if (strcmp(_governor, "unknown") == 0)
+      env_set(_governor, sizeof(_governor), value);
+    else if (strcmp(_governor, value) != 0)
+      env_set(_governor, sizeof(_governor), "mixed");
+  }
+
+  char value[32];
+  if (env_read_line("/sys/devices/system/cpu/cpu0/cpufreq/scaling_driver", value, sizeof(value)))
+    env_set(_scaling_driver, sizeof(_scaling_driver), value);
+
+  // Intel P-State reports disabled turbo, other drivers report enabled boost.
+  if (env_read_line("/sys/devices/system/cpu/intel_pstate/no_turbo", value, sizeof(value)))
+    env_set(_turbo, sizeof(_turbo), strcmp(value, "0") == 0 ? "on" : "off");
+  else if (env_read_line("/sys/devices/system/cpu/cpufreq/boost", value, sizeof(value)))
+    env_set(_turbo, sizeof(_turbo), strcmp(value, "0") == 0 ? "off" : "on");
+
+  if (env_read_line("/sys/devices/system/cpu/smt/control", value, sizeof(value)))
+    env_set(_smt, sizeof(_smt), value);
+
+  char loadAvg[128];
+  if (env_read_line("/proc/loadavg", loadAvg, sizeof(loadAvg)))
+    _has_load_avg = sscanf(loadAvg, "%lf %lf %lf", &_load_avg[0], &_load_avg[1], &_load_avg[2]) == 3;
+#endif
+}
+
+void EnvCheck::_checkEnvironment() {
+  if (strcmp(_governor, "unknown") != 0 && strcmp(_governor, "performance") != 0)
+    _warnings.push_back("The frequency governor is not 'performance', the frequency may change during the run");
+
+  if (strcmp(_turbo, "on") == 0)
+    _warnings.push_back("Turbo is enabled, TSC cycles don't match core cycles and depend on the temperature");
+
+  if (strcmp(_smt, "on") == 0)
+    _warnings.push_back("SMT is enabled, a sibling thread may share the core with the benchmark");
+
+  if (_has_load_avg && _load_avg[0] > kEnvMaxLoadAvg)
+    _warnings.push_back("The system is busy (load average is greater than 1.0)");
+}
+
+} // {cult} namespace
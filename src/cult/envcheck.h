@@ -0,0 +1,47 @@
+#ifndef _CULT_ENVCHECK_H
+#define _CULT_ENVCHECK_H
+
+#include "app.h"
+#include "jsonbuilder.h"
+
+#include <vector>
+
+namespace cult {
+
+// ============================================================================
+// [cult::EnvCheck]
+// ============================================================================
+
+// Captures the configuration of the system that affects results (frequency governor, turbo, SMT, microcode,
+// background load, and kernel version) and warns about configurations that make results noisy.
+//
+// The configuration is read from `/sys` and `/proc`, so it's only available on Linux. Values that cannot be read
+// are reported as "unknown" and never produce a warning.
+class EnvCheck {
+public:
+  EnvCheck(App* app);
+  ~EnvCheck();
+
+  // Returns false if the environment is noisy and `--strict-env` was used.
+  bool run();
+
+  void _queryEnvironment();
+  void _checkEnvironment();
+
+  App* _app;
+
+  char _kernel[128];
+  char _microcode[32];
+  char _governor[32];
+  char _scaling_driver[32];
+  char _turbo[16];
+  char _smt[16];
+  double _load_avg[3];
+  bool _has_load_avg;
+
+  std::vector<const char*> _warnings;
+};
+
+} // {cult} namespace
+
+#endif // _CULT_ENVCHECK_H
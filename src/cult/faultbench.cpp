@@ -0,0 +1,256 @@
+#include "faultbench.h"
+#include "memutils.h"
+#include "schedutils.h"
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <thread>
+#include <vector>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+namespace cult {
+
+static const char* fault_backing_name[FaultBench::kBackingCount] = {
+  "4k",
+  "thp"
+};
+
+static const char* fault_pattern_name[FaultBench::kPatternCount] = {
+  "read",
+  "write",
+  "populate",
+  "willneed"
+};
+
+static constexpr size_t kFault4KSize = 4096;
+static constexpr size_t kFaultThpSize = 2u * 1024u * 1024u;
+
+// Each configuration maps a new region multiple times and the fastest run is reported.
+static constexpr uint32_t kFaultRuns = 3;
+
+typedef std::chrono::steady_clock FaultClock;
+
+struct FaultThread {
+  uint32_t cpu;
+  bool pinned;
+  volatile uint8_t* begin;
+  volatile uint8_t* end;
+  bool write;
+  FaultClock::time_point start;
+  FaultClock::time_point stop;
+};
+
+// Touches each 4KB page of the thread's part of the region, all threads start when every thread is on its CPU.
+// A thread that couldn't be pinned still runs so the other threads are not blocked, the result is discarded.
+static void fault_thread_main(FaultThread* t, std::atomic<uint32_t>* arrived, uint32_t thread_count) {
+  t->pinned = SchedUtils::set_affinity(t->cpu);
+
+  arrived->fetch_add(1);
+  while (arrived->load() < thread_count)
+    continue;
+
+  t->start = FaultClock::now();
+
+  if (t->write) {
+    for (volatile uint8_t* p = t->begin; p < t->end; p += kFault4KSize)
+      *p = 1;
+  }
+  else {
+    uint32_t sum = 0;
+    for (volatile uint8_t* p = t->begin; p < t->end; p += kFault4KSize)
+      sum += *p;
+    (void)sum;
+  }
+
+  t->stop = FaultClock::now();
+}
+
+// ============================================================================
+// [cult::FaultBench]
+// ============================================================================
+
+FaultBench::FaultBench(App* app)
+  : _app(app) {
+
+  _region_size = size_t(is_64bit() ? 256u : 64u) * 1024u * 1024u;
+  _cpus = SchedUtils::allowed_cpus();
+  if (_cpus.size() > 64u)
+    _cpus.resize(64u);
+  _max_threads = uint32_t(_cpus.size());
+}
+
+FaultBench::~FaultBench() {}
+
+void FaultBench::run() {
+  JSONBuilder& json = _app->json();
+
+  std::vector<uint32_t> thread_counts;
+  for (uint32_t n = 1; n < _max_threads; n *= 2)
+    thread_counts.push_back(n);
+  thread_counts.push_back(_max_threads);
+
+  if (_app->verbose())
+    printf("Page faults (first touch of anonymous memory):\n");
+
+  json.before_record()
+      .add_key("pageFaults")
+      .open_array();
+
+  for (uint32_t backing = 0; backing < kBackingCount; backing++) {
+    for (uint32_t pattern = 0; pattern < kPatternCount; pattern++) {
+      for (uint32_t thread_count : thread_counts) {
+        Result result;
+        if (!test_faults(result, backing, pattern, thread_count))
+          continue;
+
+        size_t pageSize = backing == kBackingThp ? kFaultThpSize : kFault4KSize;
+
+        if (_app->verbose()) {
+          printf("  %-4s %-9s Threads:%-3u: PerPage:%10.1f ns Pages/s:%12.0f\n",
+            fault_backing_name[backing], fault_pattern_name[pattern], thread_count, result.ns_per_page, result.pages_per_sec);
+        }
+
+        json.before_record()
+            .open_object()
+            .add_key("backing").add_string(fault_backing_name[backing])
+            .add_key("pattern").add_string(fault_pattern_name[pattern]).align_to(40)
+            .add_key("threads").add_uint(thread_count)
+            .add_key("pageSize").add_uint(pageSize)
+            .add_key("pages").add_uint(_region_size / pageSize)
+            .add_key("nsPerPage").add_doublef("%10.1f", result.ns_per_page)
+            .add_key("pagesPerSec").add_doublef("%12.0f", result.pages_per_sec)
+            .close_object();
+      }
+    }
+  }
+
+  if (_app->verbose())
+    printf("\n");
+
+  json.close_array(true);
+}
+
+// Maps a region, touches it by the given pattern and number of threads, and unmaps it. Returns false if the
+// configuration is not supported.
+bool FaultBench::test_faults(Result& result, uint32_t backing, uint32_t pattern, uint32_t thread_count) {
+  result = Result {};
+
+#if defined(__linux__)
+  size_t pageSize = backing == kBackingThp ? kFaultThpSize : kFault4KSize;
+  size_t mapSize = _region_size + kFaultThpSize;
+  int advice = backing == kBackingThp ? MADV_HUGEPAGE : MADV_NOHUGEPAGE;
+
+  // MADV_HUGEPAGE is ignored if THP is disabled, the region would be faulted in 4KB pages.
+  if (backing == kBackingThp && !MemUtils::thp_enabled())
+    return false;
+
+  // MADV_POPULATE_WRITE respects the page size advice, MAP_POPULATE populates before the advice can be given.
+#if !defined(MADV_POPULATE_WRITE)
+  if (pattern == kPatternPopulate && backing == kBackingThp)
+    return false;
+#endif
+
+  double bestNs = 0.0;
+
+  for (uint32_t r = 0; r < kFaultRuns; r++) {
+    int flags = MAP_PRIVATE | MAP_ANONYMOUS;
+#if !defined(MADV_POPULATE_WRITE)
+    if (pattern == kPatternPopulate)
+      flags |= MAP_POPULATE;
+#endif
+
+    FaultClock::time_point mapStart = FaultClock::now();
+
+    void* p = mmap(nullptr, mapSize, PROT_READ | PROT_WRITE, flags, -1, 0);
+    if (p == MAP_FAILED)
+      return false;
+
+    uint8_t* data = reinterpret_cast<uint8_t*>((uintptr_t(p) + kFaultThpSize - 1u) & ~uintptr_t(kFaultThpSize - 1u));
+    madvise(data, _region_size, advice);
+
+#if defined(MADV_POPULATE_WRITE)
+    if (pattern == kPatternPopulate && madvise(data, _region_size, MADV_POPULATE_WRITE) != 0) {
+      munmap(p, mapSize);
+      return false;
+    }
+#endif
+
+    if (pattern == kPatternWillNeed)
+      madvise(data, _region_size, MADV_WILLNEED);
+
+    FaultClock::time_point mapEnd = FaultClock::now();
+
+    // Only populate and willneed include the time spent in mmap/madvise, the other patterns fault on touch.
+    double prepareNs = pattern == kPatternPopulate || pattern == kPatternWillNeed
+      ? std::chrono::duration<double, std::nano>(mapEnd - mapStart).count() : 0.0;
+
+    std::vector<FaultThread> threads(thread_count);
+    std::vector<std::thread> workers;
+    std::atomic<uint32_t> arrived(0);
+
+    // Parts are aligned to the page size, so a huge page is never shared by two threads.
+    size_t pageCount = _region_size / pageSize;
+    for (uint32_t i = 0; i < thread_count; i++) {
+      threads[i].cpu = _cpus[i];
+      threads[i].begin = data + (pageCount * i / thread_count) * pageSize;
+      threads[i].end = data + (pageCount * (i + 1) / thread_count) * pageSize;
+      threads[i].write = pattern != kPatternRead;
+    }
+
+    for (uint32_t i = 0; i < thread_count; i++)
+      workers.emplace_back(fault_thread_main, &threads[i], &arrived, thread_count);
+
+    for (std::thread& worker : workers)
+      worker.join();
+
+    for (const FaultThread& t : threads) {
+      if (!t.pinned) {
+        printf("FAILED to pin thread to CPU %u\n", t.cpu);
+        munmap(p, mapSize);
+        return false;
+      }
+    }
+
+    // The kernel may still fall back to 4KB pages (fragmentation, defrag policy), which would make the cost per
+    // huge page hundreds of times higher. Reads map the huge zero page, which is not reported, so only writes can
+    // be verified.
+    if (backing == kBackingThp && pattern != kPatternRead && MemUtils::thp_backed_size(data) < _region_size / 2u) {
+      if (_app->verbose())
+        printf("  %-4s %-9s Threads:%-3u: Huge pages not granted, skipped\n",
+          fault_backing_name[backing], fault_pattern_name[pattern], thread_count);
+      munmap(p, mapSize);
+      return false;
+    }
+
+    FaultClock::time_point start = threads[0].start;
+    FaultClock::time_point stop = threads[0].stop;
+
+    for (const FaultThread& t : threads) {
+      start = std::min(start, t.start);
+      stop = std::max(stop, t.stop);
+    }
+
+    double ns = prepareNs + std::chrono::duration<double, std::nano>(stop - start).count();
+    if (r == 0 || ns < bestNs)
+      bestNs = ns;
+
+    munmap(p, mapSize);
+  }
+
+  double pages = double(_region_size / pageSize);
+  result.ns_per_page = bestNs / pages;
+  result.pages_per_sec = bestNs > 0.0 ? pages * 1e9 / bestNs : 0.0;
+  return true;
+#else
+  (void)backing;
+  (void)pattern;
+  (void)thread_count;
+  return false;
+#endif
+}
+
+} // {cult} namespace
@@ -0,0 +1,61 @@
+#ifndef _CULT_FAULTBENCH_H
+#define _CULT_FAULTBENCH_H
+
+#include "app.h"
+
+#include <vector>
+
+namespace cult {
+
+// ============================================================================
+// [cult::FaultBench]
+// ============================================================================
+
+// Measures the cost of page faults when anonymous memory is touched for the first time.
+//
+// A region is mapped and touched by reads (which map the shared zero page), by writes (which allocate and clear
+// pages), or populated upfront by MAP_POPULATE / MADV_POPULATE_WRITE or MADV_WILLNEED before it's written. The
+// region is split between 1..N threads, each pinned to its own CPU, which shows how the fault path scales. This
+// benchmark doesn't generate code, it measures the operating system (Linux only).
+class FaultBench {
+public:
+  enum Backing : uint32_t {
+    kBacking4K,
+    kBackingThp,
+
+    kBackingCount
+  };
+
+  enum Pattern : uint32_t {
+    kPatternRead,
+    kPatternWrite,
+    kPatternPopulate,
+    kPatternWillNeed,
+
+    kPatternCount
+  };
+
+  struct Result {
+    double ns_per_page;
+    double pages_per_sec;
+  };
+
+  FaultBench(App* app);
+  ~FaultBench();
+
+  inline bool is_64bit() const {
+    return Environment::is_64bit(Arch::kHost);
+  }
+
+  void run();
+  bool test_faults(Result& result, uint32_t backing, uint32_t pattern, uint32_t thread_count);
+
+  App* _app;
+  size_t _region_size;
+  std::vector<uint32_t> _cpus;
+  uint32_t _max_threads;
+};
+
+} // {cult} namespace
+
+#endif // _CULT_FAULTBENCH_H
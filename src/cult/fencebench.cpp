@@ -0,0 +1,259 @@
+#include "fencebench.h"
+#include "random.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+namespace cult {
+
+static const char* fence_primitive_name[FenceBench::kPrimitiveCount] = {
+  "pause",
+  "tpause (C0.1)",
+  "umonitor + umwait (C0.1)",
+  "serialize",
+  "lfence",
+  "sfence",
+  "mfence",
+  "cpuid"
+};
+
+static const char* fence_context_name[FenceBench::kContextCount] = {
+  "empty",
+  "loads",
+  "stores"
+};
+
+// Number of loads or stores in flight before each primitive.
+static const uint32_t fence_counts[] = { 1, 4, 8 };
+
+// Tests that miss the cache are too slow for `measure_best()`, the best of a fixed number of runs is used instead.
+static constexpr uint32_t kFenceMemIter = 16;
+static constexpr uint32_t kFenceMemRuns = 1000;
+
+// ============================================================================
+// [cult::FenceBench]
+// ============================================================================
+
+FenceBench::FenceBench(App* app)
+  : BaseBench(app),
+    _primitive(0),
+    _context(0),
+    _count(0),
+    _overhead_only(false),
+    _n_unroll(16) {
+
+  // Accessed lines are random within the buffer, which is much larger than the last level cache. The buffer is
+  // initialized so it's not backed by a shared zero page.
+  _data_size = 64u * 1024u * 1024u;
+  _data = static_cast<uint8_t*>(malloc(_data_size));
+  memset(_data, 1, _data_size);
+  lock_data(_data, _data_size);
+}
+
+FenceBench::~FenceBench() {
+  free(_data);
+}
+
+uint32_t FenceBench::local_stack_size() const {
+  return 0;
+}
+
+bool FenceBench::can_test(uint32_t primitive) const {
+  switch (primitive) {
+    case kPrimitiveTpause:
+    case kPrimitiveUmwait:
+      return x86_features().has_waitpkg();
+
+    case kPrimitiveSerialize:
+      return x86_features().has_serialize();
+
+    default:
+      return true;
+  }
+}
+
+void FenceBench::run() {
+  JSONBuilder& json = _app->json();
+
+  if (_app->verbose())
+    printf("Spin-wait and serialization primitives (cycles per primitive):\n");
+
+  json.before_record()
+      .add_key("fencePrimitives")
+      .open_array();
+
+  for (uint32_t primitive = 0; primitive < kPrimitiveCount; primitive++) {
+    if (!can_test(primitive))
+      continue;
+
+    for (uint32_t context = 0; context < kContextCount; context++) {
+      for (uint32_t count : fence_counts) {
+        if (context == kContextEmpty && count != fence_counts[0])
+          break;
+
+        uint32_t n = context == kContextEmpty ? 0u : count;
+        double baseline = test_primitive(primitive, context, n, true);
+        double cycles = test_primitive(primitive, context, n, false);
+        double cost = std::max<double>(cycles - baseline, 0);
+
+        if (_app->verbose()) {
+          printf("  %-24s %-6s N:%u: Cycles:%8.2f Baseline:%8.2f Cost:%8.2f\n",
+            fence_primitive_name[primitive], fence_context_name[context], n, cycles, baseline, cost);
+        }
+
+        json.before_record()
+            .open_object()
+            .add_key("inst").add_string(fence_primitive_name[primitive]).align_to(40)
+            .add_key("context").add_string(fence_context_name[context])
+            .add_key("count").add_uint(n)
+            .add_key("cycles").add_doublef("%8.2f", cycles)
+            .add_key("baselineCycles").add_doublef("%8.2f", baseline)
+            .add_key("cost").add_doublef("%8.2f", cost)
+            .close_object();
+      }
+    }
+  }
+
+  if (_app->verbose())
+    printf("\n");
+
+  json.close_array(true);
+}
+
+double FenceBench::test_primitive(uint32_t primitive, uint32_t context, uint32_t count, bool overhead_only) {
+  _primitive = primitive;
+  _context = context;
+  _count = count;
+  _overhead_only = overhead_only;
+
+  Func func = compile_func();
+  if (!func) {
+    printf("FAILED to compile function for '%s'\n", fence_primitive_name[primitive]);
+    return -1.0;
+  }
+
+  uint32_t nIter;
+  uint64_t best;
+
+  if (context == kContextEmpty) {
+    nIter = primitive == kPrimitiveCpuid ? 4 : 160;
+    best = measure_best(func, nIter);
+  }
+  else {
+    nIter = kFenceMemIter;
+    func(nIter, &best);
+
+    for (uint32_t i = 1; i < kFenceMemRuns; i++) {
+      uint64_t n;
+      func(nIter, &n);
+      best = std::min(best, n);
+    }
+  }
+
+  release_func(func);
+  return double(best) / (double(nIter * _n_unroll));
+}
+
+void FenceBench::before_body(x86::Assembler& a) {
+  (void)a;
+}
+
+void FenceBench::compile_body(x86::Assembler& a, x86::Gp reg_cnt) {
+  x86::Gp base = a.zsi();
+  x86::Gp offset = a.zdi();
+
+  // Each iteration starts at a random offset within the first half of the buffer and each access adds a random
+  // displacement within the second half, so the accessed lines are unpredictable and don't repeat.
+  uint32_t half_mask = (_data_size / 2u - 1u) & ~63u;
+  Random rg(0x5EEDu + _count);
+
+  a.mov(base, uintptr_t(_data));
+  a.mov(x86::edi, 0x1234u);
+
+  Label L_Body = a.new_label();
+  Label L_End = a.new_label();
+
+  a.test(reg_cnt, reg_cnt);
+  a.jz(L_End);
+
+  a.align(AlignMode::kCode, 64);
+  a.bind(L_Body);
+
+  if (_context != kContextEmpty) {
+    a.imul(x86::edi, x86::edi, 1103515245);
+    a.add(x86::edi, 12345);
+    a.and_(x86::edi, half_mask);
+  }
+
+  for (uint32_t n = 0; n < _n_unroll; n++) {
+    for (uint32_t i = 0; i < _count; i++) {
+      x86::Mem m = x86::dword_ptr(base, offset, 0, int32_t(rg.next_uint32() & half_mask));
+
+      if (_context == kContextLoads)
+        a.mov(x86::ebx, m);
+      else
+        a.mov(m, x86::ebx);
+    }
+
+    if (!_overhead_only)
+      emit_primitive(a);
+  }
+
+  a.sub(reg_cnt, 1);
+  a.jnz(L_Body);
+  a.bind(L_End);
+}
+
+void FenceBench::after_body(x86::Assembler& a) {
+  (void)a;
+}
+
+void FenceBench::emit_primitive(x86::Assembler& a) {
+  switch (_primitive) {
+    case kPrimitivePause:
+      a.pause();
+      break;
+
+    // The deadline (EDX:EAX) has already passed, so the wait only costs its entry and exit. ECX selects C0.1,
+    // which is the lighter state with faster wakeup.
+    case kPrimitiveTpause:
+      a.xor_(x86::eax, x86::eax);
+      a.xor_(x86::edx, x86::edx);
+      a.mov(x86::ecx, 1);
+      a.tpause(x86::ecx, x86::edx, x86::eax);
+      break;
+
+    case kPrimitiveUmwait:
+      a.mov(a.zcx(), a.zsi());
+      a.umonitor(a.zcx());
+      a.xor_(x86::eax, x86::eax);
+      a.xor_(x86::edx, x86::edx);
+      a.mov(x86::ecx, 1);
+      a.umwait(x86::ecx, x86::edx, x86::eax);
+      break;
+
+    case kPrimitiveSerialize:
+      a.serialize();
+      break;
+
+    case kPrimitiveLfence:
+      a.lfence();
+      break;
+
+    case kPrimitiveSfence:
+      a.sfence();
+      break;
+
+    case kPrimitiveMfence:
+      a.mfence();
+      break;
+
+    case kPrimitiveCpuid:
+      a.xor_(x86::eax, x86::eax);
+      a.xor_(x86::ecx, x86::ecx);
+      a.cpuid();
+      break;
+  }
+}
+
+} // {cult} namespace
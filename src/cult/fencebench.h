@@ -0,0 +1,71 @@
+#ifndef _CULT_FENCEBENCH_H
+#define _CULT_FENCEBENCH_H
+
+#include "basebench.h"
+
+namespace cult {
+
+// ============================================================================
+// [cult::FenceBench]
+// ============================================================================
+
+// Measures the cost of spin-wait hints, fences, and serializing instructions depending on the memory operations
+// that are in flight when they execute.
+//
+// Each primitive is executed in an empty pipeline, after N independent loads that miss the cache, and after M
+// stores to lines that miss the cache. The same sequence without the primitive is measured as a baseline, the
+// difference is the cost of the primitive (for example LFENCE has to wait for the loads, MFENCE for the stores).
+class FenceBench : public BaseBench {
+public:
+  enum Primitive : uint32_t {
+    kPrimitivePause,
+    kPrimitiveTpause,
+    kPrimitiveUmwait,
+    kPrimitiveSerialize,
+    kPrimitiveLfence,
+    kPrimitiveSfence,
+    kPrimitiveMfence,
+    kPrimitiveCpuid,
+
+    kPrimitiveCount
+  };
+
+  enum Context : uint32_t {
+    kContextEmpty,
+    kContextLoads,
+    kContextStores,
+
+    kContextCount
+  };
+
+  FenceBench(App* app);
+  virtual ~FenceBench();
+
+  inline bool is_64bit() const {
+    return Environment::is_64bit(Arch::kHost);
+  }
+
+  bool can_test(uint32_t primitive) const;
+  double test_primitive(uint32_t primitive, uint32_t context, uint32_t count, bool overhead_only);
+
+  uint32_t local_stack_size() const override;
+  void run() override;
+  void before_body(x86::Assembler& a) override;
+  void compile_body(x86::Assembler& a, x86::Gp reg_cnt) override;
+  void after_body(x86::Assembler& a) override;
+
+  void emit_primitive(x86::Assembler& a);
+
+  uint32_t _primitive {};
+  uint32_t _context {};
+  uint32_t _count {};
+  bool _overhead_only {};
+  uint32_t _n_unroll {};
+
+  uint32_t _data_size {};
+  uint8_t* _data {};
+};
+
+} // {cult} namespace
+
+#endif // _CULT_FENCEBENCH_H
@@ -0,0 +1,235 @@
+#include "flushbench.h"
+#include "cpuutils.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+namespace cult {
+
+static const char* flush_inst_name[FlushBench::kInstCount] = {
+  "clflush",
+  "clflushopt",
+  "clwb",
+  "cldemote"
+};
+
+static const char* flush_level_name[FlushBench::kLevelCount] = {
+  "l1",
+  "l2",
+  "l3",
+  "mem"
+};
+
+// Number of lines flushed by a single batch.
+static const uint32_t flush_batch_lines[] = { 1, 4, 16, 64 };
+
+// Maximum number of lines of a batch.
+static constexpr uint32_t kFlushMaxLines = 64;
+
+// Each run prepares lines again, so only a single batch is measured per run and the best of many runs is used.
+static constexpr uint32_t kFlushRuns = 200;
+
+// ============================================================================
+// [cult::FlushBench]
+// ============================================================================
+
+FlushBench::FlushBench(App* app)
+  : BaseBench(app),
+    _inst(0),
+    _level(0),
+    _dirty(false),
+    _lines(0),
+    _fence(false) {
+
+  for (uint32_t i = 0; i < 2; i++)
+    _cache_size[i] = CpuUtils::get_cache_size(i + 1);
+
+  if (!_cache_size[0]) _cache_size[0] = 32u * 1024u;
+  if (!_cache_size[1]) _cache_size[1] = 1024u * 1024u;
+
+  _lines_data = calloc(1, kFlushMaxLines * 64 + 4096);
+  _aligned_lines = reinterpret_cast<uint8_t*>((uintptr_t(_lines_data) + 4095u) & ~uintptr_t(4095u));
+
+  // The eviction buffer is read to move lines from L1 to L2 (or from L2 to L3), it's twice the size of L2.
+  _evict_size = _cache_size[1] * 2;
+  _evict_data = static_cast<uint8_t*>(malloc(_evict_size));
+  memset(_evict_data, 1, _evict_size);
+
+  lock_data(_lines_data, kFlushMaxLines * 64 + 4096);
+  lock_data(_evict_data, _evict_size);
+}
+
+FlushBench::~FlushBench() {
+  free(_lines_data);
+  free(_evict_data);
+}
+
+uint32_t FlushBench::local_stack_size() const {
+  return 0;
+}
+
+bool FlushBench::can_test(uint32_t inst) const {
+  switch (inst) {
+    case kInstClflush   : return x86_features().has_clflush();
+    case kInstClflushopt: return x86_features().has_clflushopt();
+    case kInstClwb      : return x86_features().has_clwb();
+    case kInstCldemote  : return x86_features().has_cldemote();
+    default:
+      return true;
+  }
+}
+
+void FlushBench::run() {
+  JSONBuilder& json = _app->json();
+
+  if (_app->verbose())
+    printf("Cache control instructions (cycles per batch and per line):\n");
+
+  json.before_record()
+      .add_key("cacheControl")
+      .open_array();
+
+  for (uint32_t inst = 0; inst < kInstCount; inst++) {
+    if (!can_test(inst))
+      continue;
+
+    for (uint32_t f = 0; f < 2; f++) {
+      bool fence = f != 0;
+
+      for (uint32_t level = 0; level < kLevelCount; level++) {
+        for (uint32_t d = 0; d < 2; d++) {
+          bool dirty = d != 0;
+
+          // Lines in memory cannot be modified.
+          if (dirty && level == kLevelMem)
+            continue;
+
+          for (uint32_t lines : flush_batch_lines) {
+            double overhead = test_flush(kInstNone, level, dirty, lines, false);
+            double cycles = std::max<double>(test_flush(inst, level, dirty, lines, fence) - overhead, 0);
+            double perLine = cycles / double(lines);
+
+            StringTmp<64> name;
+            name.append(flush_inst_name[inst]);
+            if (fence)
+              name.append(" + sfence");
+
+            if (_app->verbose()) {
+              printf("  %-20s %-3s %-5s N:%-3u: Cycles:%8.2f PerLine:%7.2f\n",
+                name.data(), flush_level_name[level], dirty ? "dirty" : "clean", lines, cycles, perLine);
+            }
+
+            json.before_record()
+                .open_object()
+                .add_key("inst").add_string(name.data()).align_to(36)
+                .add_key("level").add_string(flush_level_name[level])
+                .add_key("state").add_string(dirty ? "dirty" : "clean")
+                .add_key("lines").add_uint(lines)
+                .add_key("cycles").add_doublef("%8.2f", cycles)
+                .add_key("cyclesPerLine").add_doublef("%7.2f", perLine)
+                .close_object();
+          }
+        }
+      }
+    }
+  }
+
+  if (_app->verbose())
+    printf("\n");
+
+  json.close_array(true);
+}
+
+double FlushBench::test_flush(uint32_t inst, uint32_t level, bool dirty, uint32_t lines, bool fence) {
+  _inst = inst;
+  _level = level;
+  _dirty = dirty;
+  _lines = lines;
+  _fence = fence;
+
+  Func func = compile_func();
+  if (!func) {
+    printf("FAILED to compile function for cache control test\n");
+    return -1.0;
+  }
+
+  uint64_t best;
+  func(1, &best);
+
+  for (uint32_t i = 1; i < kFlushRuns; i++) {
+    uint64_t n;
+    func(1, &n);
+    best = std::min(best, n);
+  }
+
+  release_func(func);
+  return double(best);
+}
+
+// Prepares lines before the measurement starts.
+void FlushBench::before_body(x86::Assembler& a) {
+  x86::Gp lines = a.zdi();
+  a.mov(lines, uintptr_t(_aligned_lines));
+
+  for (uint32_t i = 0; i < _lines; i++) {
+    x86::Mem m = x86::dword_ptr(lines, int32_t(i * 64));
+    if (_dirty)
+      a.mov(m, x86::eax);
+    else
+      a.mov(x86::eax, m);
+  }
+
+  if (_level == kLevelL2 || _level == kLevelL3) {
+    Label L_Evict = a.new_label();
+    uint32_t evictSize = _level == kLevelL2 ? _cache_size[0] * 2 : _evict_size;
+
+    a.mov(a.zsi(), uintptr_t(_evict_data));
+    a.mov(x86::ecx, evictSize / 64);
+    a.bind(L_Evict);
+    a.mov(x86::eax, x86::dword_ptr(a.zsi()));
+    a.add(a.zsi(), 64);
+    a.sub(x86::ecx, 1);
+    a.jnz(L_Evict);
+  }
+
+  if (_level == kLevelMem) {
+    for (uint32_t i = 0; i < _lines; i++)
+      a.clflush(x86::byte_ptr(lines, int32_t(i * 64)));
+  }
+}
+
+void FlushBench::compile_body(x86::Assembler& a, x86::Gp reg_cnt) {
+  x86::Gp lines = a.zdi();
+
+  Label L_Body = a.new_label();
+  Label L_End = a.new_label();
+
+  a.test(reg_cnt, reg_cnt);
+  a.jz(L_End);
+
+  a.bind(L_Body);
+
+  for (uint32_t i = 0; i < _lines; i++) {
+    x86::Mem m = x86::byte_ptr(lines, int32_t(i * 64));
+
+    switch (_inst) {
+      case kInstClflush   : a.clflush(m); break;
+      case kInstClflushopt: a.clflushopt(m); break;
+      case kInstClwb      : a.clwb(m); break;
+      case kInstCldemote  : a.cldemote(m); break;
+    }
+  }
+
+  if (_fence)
+    a.sfence();
+
+  a.sub(reg_cnt, 1);
+  a.jnz(L_Body);
+  a.bind(L_End);
+}
+
+void FlushBench::after_body(x86::Assembler& a) {
+  (void)a;
+}
+
+} // {cult} namespace
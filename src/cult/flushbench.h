@@ -0,0 +1,71 @@
+#ifndef _CULT_FLUSHBENCH_H
+#define _CULT_FLUSHBENCH_H
+
+#include "basebench.h"
+
+namespace cult {
+
+// ============================================================================
+// [cult::FlushBench]
+// ============================================================================
+
+// Measures the cost of cache control instructions depending on where the flushed lines are and whether they are
+// modified.
+//
+// Lines are prepared before the measured part of each run: they are loaded (clean) or stored to (dirty) and then
+// moved to the requested level by reading an eviction buffer twice the size of the level above (or flushed to
+// memory). A batch of N lines is then flushed, optionally followed by SFENCE, which waits for CLFLUSHOPT and CLWB
+// to complete. A run without flushes is measured as a baseline and subtracted.
+class FlushBench : public BaseBench {
+public:
+  enum Inst : uint32_t {
+    kInstClflush,
+    kInstClflushopt,
+    kInstClwb,
+    kInstCldemote,
+    kInstNone,
+
+    kInstCount = kInstNone
+  };
+
+  enum Level : uint32_t {
+    kLevelL1,
+    kLevelL2,
+    kLevelL3,
+    kLevelMem,
+
+    kLevelCount
+  };
+
+  FlushBench(App* app);
+  virtual ~FlushBench();
+
+  inline bool is_64bit() const {
+    return Environment::is_64bit(Arch::kHost);
+  }
+
+  bool can_test(uint32_t inst) const;
+  double test_flush(uint32_t inst, uint32_t level, bool dirty, uint32_t lines, bool fence);
+
+  uint32_t local_stack_size() const override;
+  void run() override;
+  void before_body(x86::Assembler& a) override;
+  void compile_body(x86::Assembler& a, x86::Gp reg_cnt) override;
+  void after_body(x86::Assembler& a) override;
+
+  uint32_t _inst {};
+  uint32_t _level {};
+  bool _dirty {};
+  uint32_t _lines {};
+  bool _fence {};
+
+  uint32_t _cache_size[2] {};
+  void* _lines_data {};
+  uint8_t* _aligned_lines {};
+  uint32_t _evict_size {};
+  uint8_t* _evict_data {};
+};
+
+} // {cult} namespace
+
+#endif // _CULT_FLUSHBENCH_H
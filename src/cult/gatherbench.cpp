@@ -0,0 +1,313 @@
+#include "gatherbench.h"
+#include "cpuutils.h"
+#include "random.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+namespace cult {
+
+struct GatherVariantInfo {
+  const char* name;
+  uint32_t lanes;
+};
+
+static const GatherVariantInfo gather_variant_info[GatherBench::kVariantCount] = {
+  { "vpgatherdd xmm, [m + xmm * 4], xmm"   , 4  },
+  { "vpgatherdd ymm, [m + ymm * 4], ymm"   , 8  },
+  { "vpgatherdd zmm {k}, [m + zmm * 4]"    , 16 },
+  { "vpscatterdd [m + xmm * 4] {k}, xmm"   , 4  },
+  { "vpscatterdd [m + ymm * 4] {k}, ymm"   , 8  },
+  { "vpscatterdd [m + zmm * 4] {k}, zmm"   , 16 }
+};
+
+static const char* gather_pattern_name[GatherBench::kPatternCount] = {
+  "same-line",
+  "sequential",
+  "strided",
+  "random-l1",
+  "random-l2",
+  "random-l3",
+  "random-mem"
+};
+
+static const char* gather_mask_name[GatherBench::kMaskCount] = {
+  "all",
+  "half",
+  "sparse"
+};
+
+// Active lanes of each mask density (lane 0 is the least significant bit).
+static const uint32_t gather_mask_bits[GatherBench::kMaskCount] = {
+  0xFFFFu,
+  0x5555u,
+  0x0101u
+};
+
+// Index stream contains one vector of 16 indexes for each gather.
+static constexpr uint32_t kGatherIndexStride = 64;
+
+// ============================================================================
+// [cult::GatherBench]
+// ============================================================================
+
+GatherBench::GatherBench(App* app)
+  : BaseBench(app),
+    _variant(0),
+    _mask(0),
+    _overhead_only(false),
+    _n_iter(160),
+    _n_unroll(64) {
+
+  for (uint32_t i = 0; i < 3; i++)
+    _cache_size[i] = CpuUtils::get_cache_size(i + 1);
+
+  // The largest table is used by all patterns, it's initialized so it's not backed by a shared zero page.
+  _table_size = table_size(kPatternRandomMem);
+  _table = static_cast<uint32_t*>(malloc(_table_size));
+  memset(_table, 1, _table_size);
+
+  _indexes = static_cast<uint32_t*>(malloc(size_t(_n_iter) * _n_unroll * kGatherIndexStride));
+
+  lock_data(_table, _table_size);
+  lock_data(_indexes, size_t(_n_iter) * _n_unroll * kGatherIndexStride);
+}
+
+GatherBench::~GatherBench() {
+  free(_table);
+  free(_indexes);
+}
+
+uint32_t GatherBench::local_stack_size() const {
+  return 0;
+}
+
+bool GatherBench::can_test(uint32_t variant) const {
+  switch (variant) {
+    case kVariantGatherX:
+    case kVariantGatherY:
+      return x86_features().has_avx2();
+
+    case kVariantGatherZ:
+    case kVariantScatterZ:
+      return x86_features().has_avx512_f();
+
+    case kVariantScatterX:
+    case kVariantScatterY:
+      return x86_features().has_avx512_f() && x86_features().has_avx512_vl();
+
+    default:
+      return false;
+  }
+}
+
+// Random tables use a half of the respective cache (or the defaults if the cache size is unknown) so they fit it.
+uint32_t GatherBench::table_size(uint32_t pattern) const {
+  uint32_t l1 = _cache_size[0] ? _cache_size[0] : 32u * 1024u;
+  uint32_t l2 = _cache_size[1] ? _cache_size[1] : 1024u * 1024u;
+  uint32_t l3 = _cache_size[2] ? _cache_size[2] : 8u * 1024u * 1024u;
+
+  switch (pattern) {
+    case kPatternRandomL2:
+      return l2 / 2;
+
+    case kPatternRandomL3:
+      return l3 / 2;
+
+    case kPatternRandomMem: {
+      uint32_t maxSize = (is_64bit() ? 256u : 64u) * 1024u * 1024u;
+      return std::min(std::max(l3 * 4u, 64u * 1024u * 1024u), maxSize);
+    }
+
+    default:
+      return l1 / 2;
+  }
+}
+
+void GatherBench::fill_indexes(uint32_t pattern) {
+  uint32_t lanes = gather_variant_info[_variant].lanes;
+  uint32_t count = table_size(pattern) / 4;
+  uint32_t vectorCount = _n_iter * _n_unroll;
+
+  Random rg(0x1234u + pattern);
+
+  for (uint32_t v = 0; v < vectorCount; v++) {
+    uint32_t* d = _indexes + v * (kGatherIndexStride / 4);
+    uint32_t line = rg.next_uint32() % (count / 16);
+
+    for (uint32_t lane = 0; lane < 16; lane++) {
+      uint32_t i = v * lanes + lane;
+
+      switch (pattern) {
+        case kPatternSameLine  : d[lane] = line * 16 + lane; break;
+        case kPatternSequential: d[lane] = i % count; break;
+        case kPatternStrided   : d[lane] = (i * 16) % count; break;
+        default                : d[lane] = rg.next_uint32() % count; break;
+      }
+    }
+  }
+}
+
+void GatherBench::run() {
+  JSONBuilder& json = _app->json();
+
+  if (_app->verbose())
+    printf("Gather & scatter (cycles per instruction and per active element):\n");
+
+  json.before_record()
+      .add_key("gatherScatter")
+      .open_array();
+
+  for (uint32_t variant = 0; variant < kVariantCount; variant++) {
+    if (!can_test(variant))
+      continue;
+
+    const GatherVariantInfo& info = gather_variant_info[variant];
+    _variant = variant;
+
+    for (uint32_t pattern = 0; pattern < kPatternCount; pattern++) {
+      fill_indexes(pattern);
+
+      for (uint32_t mask = 0; mask < kMaskCount; mask++) {
+        uint32_t active = Support::popcnt(gather_mask_bits[mask] & ((1u << info.lanes) - 1u));
+
+        double overhead = test_variant(variant, mask, true);
+        double cycles = std::max<double>(test_variant(variant, mask, false) - overhead, 0);
+        double perElement = cycles / double(active);
+
+        if (_app->verbose()) {
+          printf("  %-36s %-10s %-6s: Cycles:%7.2f PerElement:%7.2f\n",
+            info.name, gather_pattern_name[pattern], gather_mask_name[mask], cycles, perElement);
+        }
+
+        json.before_record()
+            .open_object()
+            .add_key("inst").add_string(info.name).align_to(48)
+            .add_key("lanes").add_uint(info.lanes)
+            .add_key("pattern").add_string(gather_pattern_name[pattern])
+            .add_key("mask").add_string(gather_mask_name[mask])
+            .add_key("active").add_uint(active)
+            .add_key("cycles").add_doublef("%7.2f", cycles)
+            .add_key("cyclesPerElement").add_doublef("%7.2f", perElement)
+            .close_object();
+      }
+    }
+  }
+
+  if (_app->verbose())
+    printf("\n");
+
+  json.close_array(true);
+}
+
+double GatherBench::test_variant(uint32_t variant, uint32_t mask, bool overhead_only) {
+  _variant = variant;
+  _mask = mask;
+  _overhead_only = overhead_only;
+
+  Func func = compile_func();
+  if (!func) {
+    printf("FAILED to compile function for '%s'\n", gather_variant_info[variant].name);
+    return -1.0;
+  }
+
+  uint64_t best = measure_best(func, _n_iter);
+
+  release_func(func);
+  return double(best) / (double(_n_iter * _n_unroll));
+}
+
+void GatherBench::before_body(x86::Assembler& a) {
+  for (uint32_t i = 0; i < 8; i++)
+    a.vpxor(x86::xmm(i), x86::xmm(i), x86::xmm(i));
+}
+
+void GatherBench::compile_body(x86::Assembler& a, x86::Gp reg_cnt) {
+  uint32_t lanes = gather_variant_info[_variant].lanes;
+  bool is_scatter = _variant >= kVariantScatterX;
+  bool is_avx512 = is_scatter || _variant == kVariantGatherZ;
+
+  auto vec = [&](uint32_t id) -> x86::Vec {
+    return lanes == 4 ? x86::xmm(id) : lanes == 8 ? x86::ymm(id) : x86::zmm(id);
+  };
+
+  x86::Gp indexes = a.zsi();
+  x86::Gp table = a.zdi();
+
+  a.mov(indexes, uintptr_t(_indexes));
+  a.mov(table, uintptr_t(_table));
+
+  // AVX-512 uses K7 as a mask source, AVX2 uses sign bits of VEC7. Gathers and scatters clear the mask, so it's
+  // copied before each instruction.
+  if (is_avx512) {
+    a.mov(x86::eax, gather_mask_bits[_mask]);
+    a.kmovw(x86::k7, x86::eax);
+  }
+  else {
+    for (uint32_t i = 0; i < 16; i++)
+      _mask_data[i] = (gather_mask_bits[_mask] & (1u << i)) ? 0x80000000u : 0u;
+
+    a.mov(a.zax(), uintptr_t(_mask_data));
+    a.vmovdqu(x86::ymm7, x86::ptr(a.zax()));
+  }
+
+  Label L_Body = a.new_label();
+  Label L_End = a.new_label();
+
+  a.test(reg_cnt, reg_cnt);
+  a.jz(L_End);
+
+  a.align(AlignMode::kCode, 64);
+  a.bind(L_Body);
+
+  for (uint32_t n = 0; n < _n_unroll; n++) {
+    x86::Vec index = vec(n % 3);
+    x86::Vec data = vec(3 + n % 3);
+    x86::Mem indexMem = x86::ptr(indexes, int32_t(n * kGatherIndexStride));
+
+    if (lanes == 16)
+      a.vmovdqu32(index, indexMem);
+    else
+      a.vmovdqu(index, indexMem);
+
+    // Gathers merge into the destination, zeroing it breaks the dependency on the previous gather.
+    if (!is_scatter) {
+      if (lanes == 16)
+        a.vpxord(data, data, data);
+      else
+        a.vpxor(data, data, data);
+    }
+
+    x86::Mem m = x86::ptr(table, index, 2);
+
+    if (is_avx512) {
+      x86::KReg k = x86::k(1 + n % 3);
+      a.kmovw(k, x86::k7);
+
+      if (!_overhead_only) {
+        if (is_scatter)
+          a.k(k).vpscatterdd(m, data);
+        else
+          a.k(k).vpgatherdd(data, m);
+      }
+    }
+    else {
+      x86::Vec predicate = vec(6);
+      a.vmovdqa(predicate, vec(7));
+
+      if (!_overhead_only)
+        a.vpgatherdd(data, m, predicate);
+    }
+  }
+
+  a.add(indexes, int32_t(_n_unroll * kGatherIndexStride));
+  a.sub(reg_cnt, 1);
+  a.jnz(L_Body);
+  a.bind(L_End);
+}
+
+void GatherBench::after_body(x86::Assembler& a) {
+  a.vzeroupper();
+}
+
+} // {cult} namespace
@@ -0,0 +1,83 @@
+#ifndef _CULT_GATHERBENCH_H
+#define _CULT_GATHERBENCH_H
+
+#include "basebench.h"
+
+namespace cult {
+
+// ============================================================================
+// [cult::GatherBench]
+// ============================================================================
+
+// Measures throughput of gathers and scatters depending on index locality, lane count, and mask density.
+//
+// Each gather (or scatter) uses a new index vector, which is loaded from a precomputed index stream, so the
+// accessed addresses follow the selected pattern during the whole test. The cost of loading indexes and
+// preparing masks is measured separately and subtracted from the result.
+class GatherBench : public BaseBench {
+public:
+  enum Variant : uint32_t {
+    kVariantGatherX,
+    kVariantGatherY,
+    kVariantGatherZ,
+    kVariantScatterX,
+    kVariantScatterY,
+    kVariantScatterZ,
+
+    kVariantCount
+  };
+
+  enum Pattern : uint32_t {
+    kPatternSameLine,
+    kPatternSequential,
+    kPatternStrided,
+    kPatternRandomL1,
+    kPatternRandomL2,
+    kPatternRandomL3,
+    kPatternRandomMem,
+
+    kPatternCount
+  };
+
+  enum Mask : uint32_t {
+    kMaskAll,
+    kMaskHalf,
+    kMaskSparse,
+
+    kMaskCount
+  };
+
+  GatherBench(App* app);
+  virtual ~GatherBench();
+
+  inline bool is_64bit() const {
+    return Environment::is_64bit(Arch::kHost);
+  }
+
+  bool can_test(uint32_t variant) const;
+  uint32_t table_size(uint32_t pattern) const;
+  void fill_indexes(uint32_t pattern);
+  double test_variant(uint32_t variant, uint32_t mask, bool overhead_only);
+
+  uint32_t local_stack_size() const override;
+  void run() override;
+  void before_body(x86::Assembler& a) override;
+  void compile_body(x86::Assembler& a, x86::Gp reg_cnt) override;
+  void after_body(x86::Assembler& a) override;
+
+  uint32_t _variant {};
+  uint32_t _mask {};
+  bool _overhead_only {};
+  uint32_t _n_iter {};
+  uint32_t _n_unroll {};
+
+  uint32_t _cache_size[3] {};
+  uint32_t _table_size {};
+  uint32_t* _table {};
+  uint32_t* _indexes {};
+  uint32_t _mask_data[16] {};
+};
+
+} // {cult} namespace
+
+#endif // _CULT_GATHERBENCH_H
@@ -1,57 +1,19 @@
 #include "instbench.h"
-#include "cpuutils.h"
+#include "random.h"
+#include "schedutils.h"
 
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <limits>
 #include <set>
+#include <thread>
 
-namespace cult {
-
-class Random {
-public:
-  // Constants suggested as `23/18/5`.
-  enum Steps : uint32_t {
-    kStep1_SHL = 23,
-    kStep2_SHR = 18,
-    kStep3_SHR = 5
-  };
-
-  inline explicit Random(uint64_t seed = 0) noexcept { reset(seed); }
-  inline Random(const Random& other) noexcept = default;
-
-  inline void reset(uint64_t seed = 0) noexcept {
-    // The number is arbitrary, it means nothing.
-    constexpr uint64_t kZeroSeed = 0x1F0A2BE71D163FA0u;
-
-    // Generate the state data by using splitmix64.
-    for (uint32_t i = 0; i < 2; i++) {
-      seed += 0x9E3779B97F4A7C15u;
-      uint64_t x = seed;
-      x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9u;
-      x = (x ^ (x >> 27)) * 0x94D049BB133111EBu;
-      x = (x ^ (x >> 31));
-      _state[i] = x != 0 ? x : kZeroSeed;
-    }
-  }
-
-  inline uint32_t next_uint32() noexcept {
-    return uint32_t(next_uint64() >> 32);
-  }
-
-  inline uint64_t next_uint64() noexcept {
-    uint64_t x = _state[0];
-    uint64_t y = _state[1];
-
-    x ^= x << kStep1_SHL;
-    y ^= y >> kStep3_SHR;
-    x ^= x >> kStep2_SHR;
-    x ^= y;
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
 
-    _state[0] = y;
-    _state[1] = x;
-    return x + y;
-  }
-
-  uint64_t _state[2];
-};
+namespace cult {
 
 class InstSignatureIterator {
 public:
@@ -147,10 +109,15 @@ public:
   }
 };
 
-// TODO: These require pretty special register pattern - not tested yet.
-static bool is_ignored_inst(InstId inst_id) {
-  return inst_id == x86::Inst::kIdVp2intersectd ||
-         inst_id == x86::Inst::kIdVp2intersectq;
+// Returns the number of consecutive registers an operand occupies (1 for regular operands).
+//
+// Register groups must be aligned to their size - VP2INTERSECT{D|Q} writes an even/odd pair of mask
+// registers.
+static uint32_t consecutive_reg_count(InstId inst_id, uint32_t op_index) {
+  if (inst_id == x86::Inst::kIdVp2intersectd || inst_id == x86::Inst::kIdVp2intersectq)
+    return op_index == 0 ? 2 : 1;
+
+  return 1;
 }
 
 // Returns true when the instruction is safe to be benchmarked.
@@ -187,6 +154,9 @@ static bool is_safe_gp_inst(InstId inst_id) {
          inst_id == x86::Inst::kIdCdq        ||
          inst_id == x86::Inst::kIdCdqe       ||
          inst_id == x86::Inst::kIdCmp        ||
+         inst_id == x86::Inst::kIdCmpxchg    ||
+         inst_id == x86::Inst::kIdCmpxchg16b ||
+         inst_id == x86::Inst::kIdCmpxchg8b  ||
          inst_id == x86::Inst::kIdCrc32      ||
          inst_id == x86::Inst::kIdCqo        ||
          inst_id == x86::Inst::kIdCwd        ||
@@ -298,6 +268,11 @@ static bool is_safe_unaligned(InstId inst_id, uint32_t mem_op) {
   if (inst_id == x86::Inst::kIdNop)
     return false;
 
+  // XCHG with memory is always locked, a locked access that crosses a cache line locks the bus (or faults when
+  // split lock detection is enabled). CMPXCHG16B requires its memory operand to be aligned.
+  if (inst_id == x86::Inst::kIdXchg || inst_id == x86::Inst::kIdCmpxchg16b)
+    return false;
+
   if (inst.is_sse()) {
     return inst_id == x86::Inst::kIdMovdqu ||
            inst_id == x86::Inst::kIdMovupd ||
@@ -320,6 +295,33 @@ static bool is_safe_unaligned(InstId inst_id, uint32_t mem_op) {
   return true;
 }
 
+static uint32_t mem_op_size(uint32_t mem_op) {
+  switch (mem_op) {
+    case InstSpec::kOpMem8  : return 1;
+    case InstSpec::kOpMem16 : return 2;
+    case InstSpec::kOpMem32 : return 4;
+    case InstSpec::kOpMem64 : return 8;
+    case InstSpec::kOpMem128: return 16;
+    case InstSpec::kOpMem256: return 32;
+    case InstSpec::kOpMem512: return 64;
+    default                 : return 0;
+  }
+}
+
+// Converts a memory operand of `mem_size` bytes to an embedded broadcast of `element_size` bytes.
+static x86::Mem bcst_mem(x86::Mem m, uint32_t mem_size, uint32_t element_size) {
+  m.set_size(element_size);
+
+  switch (mem_size / element_size) {
+    case 2 : return m._1to2();
+    case 4 : return m._1to4();
+    case 8 : return m._1to8();
+    case 16: return m._1to16();
+    case 32: return m._1to32();
+    default: return m;
+  }
+}
+
 static void inst_spec_to_operand_array(Arch arch, Operand* operands, InstSpec spec) {
   x86::Gp p;
   if (arch == Arch::kX86)
@@ -377,6 +379,32 @@ static void inst_spec_to_operand_array(Arch arch, Operand* operands, InstSpec sp
         break;
     }
   }
+
+  if (spec.bcst_size()) {
+    for (uint32_t i = 0; i < 6; i++)
+      if (InstSpec::is_mem_op(spec.get(i)))
+        operands[i] = bcst_mem(operands[i].as<x86::Mem>(), mem_op_size(spec.get(i)), spec.bcst_size());
+  }
+}
+
+// Returns an instruction with LOCK prefix, AVX-512 masking and embedded rounding options of the spec. K1 is used
+// as a mask.
+static BaseInst inst_spec_to_base_inst(InstId inst_id, InstSpec spec) {
+  InstOptions options = InstOptions::kNone;
+
+  if (spec.is_lock())
+    options |= InstOptions::kX86_Lock;
+
+  if (spec.is_mask_zero())
+    options |= InstOptions::kX86_ZMask;
+
+  if (spec.is_rounding_sae())
+    options |= InstOptions::kX86_ER | InstOptions::kX86_RN_SAE;
+
+  if (spec.is_masked())
+    return BaseInst(inst_id, options, x86::k1);
+  else
+    return BaseInst(inst_id, options);
 }
 
 static bool is_write_only(Arch arch, InstId inst_id, InstSpec spec) {
@@ -384,13 +412,73 @@ static bool is_write_only(Arch arch, InstId inst_id, InstSpec spec) {
   inst_spec_to_operand_array(arch, operands, spec);
   InstRWInfo rw_info {};
 
-  InstAPI::query_rw_info(arch, BaseInst(inst_id), operands, spec.count(), &rw_info);
+  InstAPI::query_rw_info(arch, inst_spec_to_base_inst(inst_id, spec), operands, spec.count(), &rw_info);
   if (rw_info.op_count() > 0 && rw_info.operands()[0].is_write_only())
     return true;
 
   return false;
 }
 
+// Returns true if the overhead kernel contains code emitted for each instance of the instruction (masks of gathers
+// and scatters, sequential ops that chain write-only instructions), which a fit over unroll counts cannot separate
+// from the instruction itself.
+static bool has_instance_overhead(InstId inst_id, InstSpec spec, uint32_t parallel) {
+  if (is_gather_inst(inst_id) || is_scatter_inst(inst_id))
+    return true;
+
+  if (parallel)
+    return false;
+
+  return is_write_only(Arch::kHost, inst_id, spec) ||
+         inst_id == x86::Inst::kIdCdq  ||
+         inst_id == x86::Inst::kIdCdqe ||
+         inst_id == x86::Inst::kIdCqo  ||
+         inst_id == x86::Inst::kIdCwd  ||
+         inst_id == x86::Inst::kIdPop;
+}
+
+// Returns a link that has to be inserted between consecutive instructions to form a dependency chain.
+//
+// Only general purpose instructions are considered, as the link instructions must have a latency that
+// can be measured by the link itself (`adc reg, 0` and `mov reg, [reg]` chains).
+static uint32_t link_kind_of(Arch arch, InstId inst_id, InstSpec spec) {
+  uint32_t op_count = spec.count();
+  if (op_count == 0 || !is_safe_gp_inst(inst_id))
+    return InstBench::kLinkNone;
+
+  Operand operands[6] {};
+  inst_spec_to_operand_array(arch, operands, spec);
+  InstRWInfo rw_info {};
+
+  if (InstAPI::query_rw_info(arch, inst_spec_to_base_inst(inst_id, spec), operands, op_count, &rw_info) != kErrorOk)
+    return InstBench::kLinkNone;
+
+  // Stores are linked by loading the stored value back to the source register.
+  if (op_count == 2 && InstSpec::is_mem_op(spec.get(0)) && InstSpec::is_gp_op(spec.get(1)) &&
+      (inst_id == x86::Inst::kIdMov || inst_id == x86::Inst::kIdMovbe)) {
+    return InstBench::kLinkStoreToLoad;
+  }
+
+  bool has_write = false;
+  bool has_mem = false;
+
+  for (uint32_t i = 0; i < rw_info.op_count(); i++) {
+    if (rw_info.operands()[i].is_write())
+      has_write = true;
+  }
+
+  for (uint32_t i = 0; i < op_count; i++) {
+    if (InstSpec::is_mem_op(spec.get(i)) || InstSpec::is_vm_op(spec.get(i)))
+      has_mem = true;
+  }
+
+  // Instructions like CMP, TEST, and BT only produce flags, which `adc reg, 0` feeds back to the register.
+  if (!has_write && !has_mem && InstSpec::is_gp_op(spec.get(0)) && rw_info.write_flags() != CpuRWFlags::kNone)
+    return InstBench::kLinkFlagsToGp;
+
+  return InstBench::kLinkNone;
+}
+
 static const char* inst_spec_op_as_string(uint32_t instSpecOp) {
   switch (instSpecOp) {
     case InstSpec::kOpNone : return "none";
@@ -467,22 +555,221 @@ static void fillMemArray(Operand* dst, uint32_t count, const x86::Mem& op, uint3
   }
 }
 
-static void fillRegArray(Operand* dst, uint32_t count, uint32_t rStart, uint32_t rInc, uint32_t reg_mask, uint32_t rSign) {
+// Returns false if `reg_mask` has no available register (or no available group of `rGroup` registers).
+static bool fillRegArray(Operand* dst, uint32_t count, uint32_t rStart, uint32_t rInc, uint32_t reg_mask, uint32_t rSign, uint32_t rGroup = 1) {
   uint32_t rIdCount = 0;
   uint8_t rIdArray[64];
 
-  // Fill rIdArray[] array from the bits as specified by `reg_mask`.
+  // Fill rIdArray[] array from the bits as specified by `reg_mask`. If the operand is a group of consecutive
+  // registers only group leaders are used and only if the whole group is available in `reg_mask`.
+  uint32_t group_mask = (1u << rGroup) - 1u;
+
   asmjit::Support::BitWordIterator<uint32_t> reg_mask_iterator(reg_mask);
   while (reg_mask_iterator.has_next()) {
     uint32_t id = reg_mask_iterator.next();
-    rIdArray[rIdCount++] = uint8_t(id);
+    if (id % rGroup == 0 && ((reg_mask >> id) & group_mask) == group_mask)
+      rIdArray[rIdCount++] = uint8_t(id);
   }
 
+  if (!rIdCount)
+    return false;
+
   uint32_t rId = rStart % rIdCount;
   for (uint32_t i = 0; i < count; i++) {
     dst[i] = Reg(OperandSignature{rSign}, rIdArray[rId]);
     rId = (rId + rInc) % rIdCount;
   }
+
+  return true;
+}
+
+// Returns the number of whole aligned groups of `rGroup` consecutive registers available in `reg_mask`.
+static uint32_t count_reg_groups(uint32_t reg_mask, uint32_t rGroup) {
+  uint32_t group_mask = (1u << rGroup) - 1u;
+  uint32_t n = 0;
+
+  for (uint32_t id = 0; id < 32; id += rGroup)
+    if (((reg_mask >> id) & group_mask) == group_mask)
+      n++;
+
+  return n;
+}
+
+// Keeps only `n` lowest whole aligned groups of `rGroup` consecutive registers of `reg_mask`, which limits the
+// number of independent chains in parallel mode.
+static uint32_t limit_reg_mask(uint32_t reg_mask, uint32_t n, uint32_t rGroup) {
+  uint32_t group_mask = (1u << rGroup) - 1u;
+  uint32_t out = 0;
+
+  for (uint32_t id = 0; id < 32 && n; id += rGroup) {
+    if (((reg_mask >> id) & group_mask) == group_mask) {
+      out |= group_mask << id;
+      n--;
+    }
+  }
+
+  return out;
+}
+
+// Returns a register group of a rotated register operand or `0xFFFFFFFF` if the operand is not rotated.
+static uint32_t rotated_reg_group(uint32_t op) {
+  switch (op) {
+    case InstSpec::kOpGpb:
+    case InstSpec::kOpGpw:
+    case InstSpec::kOpGpd:
+    case InstSpec::kOpGpq:
+      return uint32_t(RegGroup::kGp);
+
+    case InstSpec::kOpXmm:
+    case InstSpec::kOpYmm:
+    case InstSpec::kOpZmm:
+      return uint32_t(RegGroup::kVec);
+
+    case InstSpec::kOpKReg:
+      return uint32_t(RegGroup::kMask);
+
+    case InstSpec::kOpMm:
+      return uint32_t(RegGroup::kX86_MM);
+
+    default:
+      return 0xFFFFFFFFu;
+  }
+}
+
+// Returns true if the instruction is a register to register move that could be eliminated by register renaming.
+static bool is_move_inst(InstId inst_id) {
+  return inst_id == x86::Inst::kIdMov        ||
+         inst_id == x86::Inst::kIdMovapd     ||
+         inst_id == x86::Inst::kIdMovaps     ||
+         inst_id == x86::Inst::kIdMovdqa     ||
+         inst_id == x86::Inst::kIdMovdqu     ||
+         inst_id == x86::Inst::kIdMovq       ||
+         inst_id == x86::Inst::kIdMovupd     ||
+         inst_id == x86::Inst::kIdMovups     ||
+         inst_id == x86::Inst::kIdMovzx      ||
+         inst_id == x86::Inst::kIdVmovapd    ||
+         inst_id == x86::Inst::kIdVmovaps    ||
+         inst_id == x86::Inst::kIdVmovdqa    ||
+         inst_id == x86::Inst::kIdVmovdqa32  ||
+         inst_id == x86::Inst::kIdVmovdqa64  ||
+         inst_id == x86::Inst::kIdVmovdqu    ||
+         inst_id == x86::Inst::kIdVmovdqu8   ||
+         inst_id == x86::Inst::kIdVmovdqu16  ||
+         inst_id == x86::Inst::kIdVmovdqu32  ||
+         inst_id == x86::Inst::kIdVmovdqu64  ||
+         inst_id == x86::Inst::kIdVmovupd    ||
+         inst_id == x86::Inst::kIdVmovups    ;
+}
+
+// Returns true if the instruction spec is a register to register move, which is checked for move elimination.
+static bool is_move_candidate(InstId inst_id, InstSpec spec) {
+  return is_move_inst(inst_id) &&
+         !spec.has_modifiers() &&
+         spec.count() == 2 &&
+         rotated_reg_group(spec.get(0)) != 0xFFFFFFFFu &&
+         rotated_reg_group(spec.get(0)) == rotated_reg_group(spec.get(1));
+}
+
+// Returns true if the instruction spec can be benchmarked with the same register used by all operands, which
+// reveals zero idioms (`xor r, r`, `vpxor x, x, x`) and other dependency breaking idioms (`pcmpeqd x, x`).
+static bool is_idiom_candidate(Arch arch, InstId inst_id, InstSpec spec) {
+  uint32_t op_count = spec.count();
+  if (op_count < 2 || op_count > 3 || spec.has_modifiers())
+    return false;
+
+  // Instructions that have special handling in compile_body() or that would swap the same register. Complex FP16
+  // instructions raise #UD when the destination is the same register as a source.
+  if (inst_id == x86::Inst::kIdDiv        ||
+      inst_id == x86::Inst::kIdIdiv       ||
+      inst_id == x86::Inst::kIdImul       ||
+      inst_id == x86::Inst::kIdLea        ||
+      inst_id == x86::Inst::kIdMul        ||
+      inst_id == x86::Inst::kIdXadd       ||
+      inst_id == x86::Inst::kIdXchg       ||
+      inst_id == x86::Inst::kIdVfcmaddcph ||
+      inst_id == x86::Inst::kIdVfmaddcph  ||
+      inst_id == x86::Inst::kIdVfcmaddcsh ||
+      inst_id == x86::Inst::kIdVfmaddcsh  ||
+      inst_id == x86::Inst::kIdVfcmulcsh  ||
+      inst_id == x86::Inst::kIdVfmulcsh   ||
+      inst_id == x86::Inst::kIdVfcmulcph  ||
+      inst_id == x86::Inst::kIdVfmulcph) {
+    return false;
+  }
+
+  for (uint32_t i = 0; i < op_count; i++)
+    if (spec.get(i) != spec.get(0) || rotated_reg_group(spec.get(i)) == 0xFFFFFFFFu)
+      return false;
+
+  Operand operands[6] {};
+  inst_spec_to_operand_array(arch, operands, spec);
+  InstRWInfo rw_info {};
+
+  if (InstAPI::query_rw_info(arch, inst_spec_to_base_inst(inst_id, spec), operands, op_count, &rw_info) != kErrorOk)
+    return false;
+
+  return rw_info.op_count() > 0 && rw_info.operands()[0].is_write() && link_kind_of(arch, inst_id, spec) == InstBench::kLinkNone;
+}
+
+static const char* addr_mode_name(uint32_t addr_mode) {
+  switch (addr_mode) {
+    case InstBench::kAddrBase          : return "[base]";
+    case InstBench::kAddrBaseDisp8     : return "[base + disp8]";
+    case InstBench::kAddrBaseDisp32    : return "[base + disp32]";
+    case InstBench::kAddrBaseIndex     : return "[base + index]";
+    case InstBench::kAddrBaseIndexDisp : return "[base + index * 8 + disp32]";
+    case InstBench::kAddrRip           : return "[rip + disp32]";
+    case InstBench::kAddr32            : return "[base32]";
+    default                            : return "[zsp]";
+  }
+}
+
+// Returns true if the instruction spec can be re-run with a different addressing form of its memory operand.
+static bool is_addr_candidate(InstId inst_id, InstSpec spec) {
+  uint32_t mem_op = spec.mem_op();
+  if (!InstSpec::is_mem_op(mem_op) || spec.has_modifiers() || spec.is_lock())
+    return false;
+
+  // Instructions that initialize their memory operands or use implicit memory operands in compile_body().
+  return inst_id != x86::Inst::kIdCall        &&
+         inst_id != x86::Inst::kIdDiv         &&
+         inst_id != x86::Inst::kIdIdiv        &&
+         inst_id != x86::Inst::kIdMaskmovq    &&
+         inst_id != x86::Inst::kIdMaskmovdqu  &&
+         inst_id != x86::Inst::kIdVmaskmovdqu &&
+         !is_gather_inst(inst_id)             &&
+         !is_scatter_inst(inst_id);
+}
+
+// Returns true if the instruction spec can form a chain where the loaded register is used as a base address of the
+// next load, which measures a load-to-use latency of the addressing form. MOV loads the address itself, the other
+// instructions add zero to it.
+static bool is_addr_chase_candidate(Arch arch, InstId inst_id, InstSpec spec) {
+  bool is_native_load = Environment::is_64bit(arch) ? spec == InstSpec::pack(InstSpec::kOpGpq, InstSpec::kOpMem64)
+                                                    : spec == InstSpec::pack(InstSpec::kOpGpd, InstSpec::kOpMem32);
+  return is_native_load && (inst_id == x86::Inst::kIdMov ||
+                            inst_id == x86::Inst::kIdAdd ||
+                            inst_id == x86::Inst::kIdSub ||
+                            inst_id == x86::Inst::kIdOr  ||
+                            inst_id == x86::Inst::kIdXor);
+}
+
+// Returns true if the memory operand of the instruction spec is written.
+static bool is_mem_written(Arch arch, InstId inst_id, InstSpec spec) {
+  uint32_t op_count = spec.count();
+
+  Operand operands[6] {};
+  inst_spec_to_operand_array(arch, operands, spec);
+  InstRWInfo rw_info {};
+
+  if (InstAPI::query_rw_info(arch, inst_spec_to_base_inst(inst_id, spec), operands, op_count, &rw_info) != kErrorOk)
+    return true;
+
+  for (uint32_t i = 0; i < op_count && i < rw_info.op_count(); i++)
+    if (InstSpec::is_mem_op(spec.get(i)) && rw_info.operands()[i].is_write())
+      return true;
+
+  return false;
 }
 
 static void fillImmArray(Operand* dst, uint32_t count, uint64_t start, uint64_t inc, uint64_t maxValue) {
@@ -520,6 +807,149 @@ static double round_result(double x) {
   return n + f;
 }
 
+// Returns the distance of `x` to the nearest value where `round_result()` changes its result.
+static double round_distance(double x) {
+  static const double boundaries[] = { 0.12, 0.22, 0.28, 0.38, 0.57, 0.70 };
+
+  double n = double(int(x));
+  double f = x - n;
+
+  if (n >= 50.0)
+    return std::fabs(f - 0.12);
+
+  double distance = 1.0;
+  for (double boundary : boundaries)
+    distance = std::min(distance, std::fabs(f - boundary));
+  return distance;
+}
+
+// Builds an instruction name including its operands that is used to identify a record in the output.
+static void inst_spec_name(String& sb, InstId inst_id, InstSpec inst_spec, uint32_t alignment, bool show_alignment) {
+  uint32_t op_count = inst_spec.count();
+
+  if (inst_spec.is_lock())
+    sb.append("lock ");
+
+  if (inst_id == x86::Inst::kIdCall) {
+    sb.append("call+ret");
+  }
+  else {
+    InstAPI::inst_id_to_string(Arch::kHost, inst_id, InstStringifyOptions::kNone, sb);
+  }
+
+  for (uint32_t i = 0; i < op_count; i++) {
+    if (i == 0)
+      sb.append(' ');
+    else if (inst_id == x86::Inst::kIdLea)
+      sb.append(i == 1 ? ", [" : " + ");
+    else
+      sb.append(", ");
+
+    sb.append(inst_spec_op_as_string(inst_spec.get(i)));
+
+    uint32_t consecutive_count = consecutive_reg_count(inst_id, i);
+    if (consecutive_count > 1 && !InstSpec::is_mem_op(inst_spec.get(i)))
+      sb.append_format("+%u", consecutive_count - 1);
+
+    if (i == 0 && (is_gather_inst(inst_id) || is_scatter_inst(inst_id)) && op_count == 2) {
+      sb.append(" {k}");
+    }
+
+    if (i == 0 && inst_spec.is_mask_merge())
+      sb.append(" {k}");
+
+    if (i == 0 && inst_spec.is_mask_zero())
+      sb.append(" {k}{z}");
+
+    if (inst_spec.bcst_size() && InstSpec::is_mem_op(inst_spec.get(i)))
+      sb.append_format(" {1to%u}", mem_op_size(inst_spec.get(i)) / inst_spec.bcst_size());
+
+    if (i == 2 && inst_spec.is_lea_scale())
+      sb.append(" * N");
+
+    if (inst_id == x86::Inst::kIdLea && i == op_count - 1)
+      sb.append(']');
+
+    if (show_alignment) {
+      if (InstSpec::is_mem_op(inst_spec.get(i)) || InstSpec::is_vm_op(inst_spec.get(i))) {
+        if (alignment == 0)
+          sb.append(" {a}");
+        else
+          sb.append(" {u}");
+      }
+    }
+  }
+
+  if (inst_spec.is_rounding_sae())
+    sb.append(" {rn-sae}");
+}
+
+// Instructions benchmarked by `--all-core` when `--instruction` is not used. They cover units that can be shared
+// between cores or that change the all-core frequency (integer multiply, FP, vector integer, crypto).
+static const InstId all_core_default_insts[] = {
+  x86::Inst::kIdAdd,
+  x86::Inst::kIdImul,
+  x86::Inst::kIdPopcnt,
+  x86::Inst::kIdAesenc,
+  x86::Inst::kIdPclmulqdq,
+  x86::Inst::kIdVpaddd,
+  x86::Inst::kIdVpmulld,
+  x86::Inst::kIdVaddps,
+  x86::Inst::kIdVmulps,
+  x86::Inst::kIdVfmadd231ps,
+  x86::Inst::kIdVdivps,
+  x86::Inst::kIdVsqrtps
+};
+
+// A single sample of an instruction test takes about this number of cycles, see `InstBench::calibrate_iter()`. As
+// `_calibrated` is set, `measure_best()` scales its stop rule to the sample size.
+static constexpr uint64_t kTargetSampleCycles = 50000;
+
+// Limits the number of iterations of tests that are faster than expected (for example eliminated instructions).
+static constexpr uint32_t kMaxIterCount = 100000;
+
+// Number of calls used to estimate the cost of a single iteration.
+static constexpr uint32_t kCalibrationCalls = 8;
+
+// Unroll counts used by `--unroll-fit`.
+static const uint32_t fit_unroll_counts[] = { 16, 32, 64, 128 };
+
+// Number of calls of the test function measured by each thread of `--all-core`.
+static constexpr uint32_t kAllCoreCalls = 20000;
+
+struct AllCoreThread {
+  InstBench::Func func;
+  uint32_t cpu;
+  uint32_t n_iter;
+  uint32_t n_calls;
+  uint64_t best;
+  bool pinned;
+};
+
+// All threads start when every thread is running on its CPU. A thread that finished its calls keeps executing
+// the test until all threads finish, so the load doesn't drop while slower threads are still measuring.
+//
+// A thread that couldn't be pinned still runs so the other threads are not blocked, the result is discarded.
+static void all_core_thread_main(AllCoreThread* t, std::atomic<uint32_t>* arrived, std::atomic<uint32_t>* finished, uint32_t thread_count) {
+  t->pinned = SchedUtils::set_affinity(t->cpu);
+
+  arrived->fetch_add(1);
+  while (arrived->load() < thread_count)
+    continue;
+
+  uint64_t n;
+  t->func(t->n_iter, &t->best);
+
+  for (uint32_t i = 1; i < t->n_calls; i++) {
+    t->func(t->n_iter, &n);
+    t->best = std::min(t->best, n);
+  }
+
+  finished->fetch_add(1);
+  while (finished->load() < thread_count)
+    t->func(t->n_iter, &n);
+}
+
 // ============================================================================
 // [cult::InstBench]
 // ============================================================================
@@ -531,11 +961,14 @@ InstBench::InstBench(App* app)
     _n_unroll(64),
     _n_parallel(0),
     _gather_data{},
-    _gather_data_size(4096) {}
+    _gather_data_size(4096) {
+  _calibrated = true;
+}
 
 InstBench::~InstBench() {
   free_gather_data(32);
   free_gather_data(64);
+  free_addr32_data();
 }
 
 const void* InstBench::ensure_gather_data(uint32_t element_size, bool is_aligned) {
@@ -545,6 +978,7 @@ const void* InstBench::ensure_gather_data(uint32_t element_size, bool is_aligned
 
   if (!_gather_data[index]) {
     _gather_data[index] = malloc(dataSize * 2 + 8);
+    lock_data(_gather_data[index], dataSize * 2 + 8);
 
     Random rg(123456789);
     uint32_t mask = _gather_data_size - 1;
@@ -579,8 +1013,31 @@ void InstBench::free_gather_data(uint32_t element_size) {
   _gather_data[index] = nullptr;
 }
 
+// 32-bit address-size form requires memory below 4GB, which can only be allocated on Linux (MAP_32BIT).
+void* InstBench::ensure_addr32_data() {
+#if defined(__linux__) && defined(MAP_32BIT)
+  if (!_addr32_data && is_64bit()) {
+    void* p = mmap(nullptr, 4096, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_32BIT, -1, 0);
+    if (p != MAP_FAILED)
+      _addr32_data = p;
+  }
+#endif
+
+  return _addr32_data;
+}
+
+void InstBench::free_addr32_data() {
+#if defined(__linux__) && defined(MAP_32BIT)
+  if (_addr32_data)
+    munmap(_addr32_data, 4096);
+#endif
+
+  _addr32_data = nullptr;
+}
+
 uint32_t InstBench::local_stack_size() const {
-  return 64 * 65;
+  // Parallel memory operands use a different 64-byte slot in each unrolled instance.
+  return 64 * (std::max<uint32_t>(_n_unroll, 64u) + 1);
 }
 
 void InstBench::run() {
@@ -588,12 +1045,18 @@ void InstBench::run() {
 
   if (_app->verbose()) {
     printf("Benchmark (latency & reciprocal throughput):\n");
-    uint64_t tsc_freq = CpuUtils::get_tsc_freq();
+    uint64_t tsc_freq = _app->tsc_freq();
     if (tsc_freq) {
       printf("TSC Frequency: %llu\n", (unsigned long long)(tsc_freq));
     }
   }
 
+  if (_app->track_freq()) {
+    _tsc_freq = _app->tsc_freq();
+    _clock.reset(new ClockBench(_app));
+    _clock->run();
+  }
+
   json.before_record()
       .add_key("instructions")
       .open_array();
@@ -606,6 +1069,8 @@ void InstBench::run() {
     instEnd = instStart + 1;
   }
 
+  std::vector<InstResult> results;
+
   for (InstId inst_id = instStart; inst_id < instEnd; inst_id++) {
     std::vector<InstSpec> specs;
     classify(specs, inst_id);
@@ -620,83 +1085,516 @@ void InstBench::run() {
 
     for (size_t i = 0; i < specs.size(); i++) {
       InstSpec inst_spec = specs[i];
-      uint32_t op_count = inst_spec.count();
       uint32_t mem_op = inst_spec.mem_op();
 
-      std::vector<uint32_t> alignments;
-      if (mem_op && mem_op != InstSpec::kOpMem8 && is_safe_unaligned(inst_id, mem_op)) {
-        alignments.push_back(0u);
-        alignments.push_back(1u);
-      }
-      else {
-        alignments.push_back(0u);
-      }
+      std::vector<uint32_t> alignments;
+      if (mem_op && mem_op != InstSpec::kOpMem8 && !inst_spec.is_lock() && is_safe_unaligned(inst_id, mem_op)) {
+        alignments.push_back(0u);
+        alignments.push_back(1u);
+      }
+      else {
+        alignments.push_back(0u);
+      }
+
+      for (uint32_t alignment : alignments) {
+        InstResult result {};
+        result.inst_id = inst_id;
+        result.inst_spec = inst_spec;
+        result.alignment = alignment;
+        result.show_alignment = alignments.size() != 1;
+        results.push_back(result);
+      }
+    }
+  }
+
+  double budget = _app->time_budget();
+
+  if (budget <= 0.0) {
+    // Results are emitted as they are measured, so the progress is visible.
+    for (InstResult& result : results) {
+      measure_inst(result);
+      emit_inst(result);
+    }
+  }
+  else {
+    typedef std::chrono::steady_clock Clock;
+    Clock::time_point deadline = Clock::now() + std::chrono::duration_cast<Clock::duration>(std::chrono::duration<double>(budget));
+
+    // The first pass measures everything with low precision, the rest of the budget refines the results that are
+    // most likely to change. Results that the first pass doesn't reach before the deadline are skipped.
+    size_t measuredCount = 0;
+
+    _quick = true;
+    for (InstResult& result : results) {
+      if (Clock::now() >= deadline)
+        break;
+
+      measure_inst(result);
+      result.measured = true;
+      measuredCount++;
+    }
+    _quick = false;
+
+    std::vector<size_t> order(results.size());
+    for (size_t i = 0; i < order.size(); i++)
+      order[i] = i;
+
+    std::stable_sort(order.begin(), order.end(), [&](size_t x, size_t y) {
+      return refine_priority(results[x]) < refine_priority(results[y]);
+    });
+
+    size_t refinedCount = 0;
+    for (size_t index : order) {
+      if (Clock::now() >= deadline)
+        break;
+
+      if (!results[index].measured)
+        continue;
+
+      measure_inst(results[index]);
+      results[index].refined = true;
+      refinedCount++;
+    }
+
+    if (_app->verbose()) {
+      printf("Time budget: %.1f seconds, measured %u and refined %u of %u results\n",
+        budget, unsigned(measuredCount), unsigned(refinedCount), unsigned(results.size()));
+    }
+
+    for (const InstResult& result : results)
+      emit_inst(result);
+  }
+
+  if (_app->verbose())
+    printf("\n");
+
+  json.close_array(true);
+
+  if (_app->addressing())
+    run_addressing();
+}
+
+// Measures latency, reciprocal throughput, and optional properties of an instruction. Results are not rounded.
+void InstBench::measure_inst(InstResult& result) {
+  InstId inst_id = result.inst_id;
+  InstSpec inst_spec = result.inst_spec;
+  uint32_t alignment = result.alignment;
+
+  // The ratio is measured before and after the instruction, the average is used to convert its cycles.
+  double ratioBefore = _clock ? _clock->measure_ratio() : 0.0;
+
+  bool unrollFit = _app->unroll_fit();
+  result.linked = link_kind_of(Arch::kHost, inst_id, inst_spec) != kLinkNone;
+
+  // Overhead kernels are only required by the fit when they are also needed by chain sweeps and idioms.
+  bool needOverhead = !unrollFit || _app->sweep_chains() || _app->idioms();
+  double overheadLat = needOverhead ? test_instruction(inst_id, inst_spec, 0, alignment, true) : 0.0;
+  double overheadRcp = needOverhead ? test_instruction(inst_id, inst_spec, 1, alignment, true) : 0.0;
+
+  double lat;
+  double rcp;
+
+  if (unrollFit) {
+    InstFit latFit = fit_instruction(inst_id, inst_spec, 0, alignment, false);
+    result.iter = _last_iter;
+    InstFit rcpFit = fit_instruction(inst_id, inst_spec, 1, alignment, false);
+
+    lat = latFit.slope;
+    rcp = rcpFit.slope;
+
+    // The loop overhead is in the intercept, code emitted for each instance must be fitted and subtracted.
+    if (has_instance_overhead(inst_id, inst_spec, 0))
+      lat -= fit_instruction(inst_id, inst_spec, 0, alignment, true).slope;
+
+    if (has_instance_overhead(inst_id, inst_spec, 1))
+      rcp -= fit_instruction(inst_id, inst_spec, 1, alignment, true).slope;
+
+    // Latency of linked instructions includes the link, which is fitted separately in the same run.
+    if (result.linked) {
+      _link_only = true;
+      lat -= fit_instruction(inst_id, inst_spec, 0, alignment, false).slope;
+      _link_only = false;
+    }
+
+    lat = std::max<double>(lat, 0);
+    rcp = std::max<double>(rcp, 0);
+    result.fit_residual = std::max(latFit.residual, rcpFit.residual);
+    result.lat_error = latFit.residual;
+    result.rcp_error = rcpFit.residual;
+  }
+  else {
+    lat = test_instruction(inst_id, inst_spec, 0, alignment, false);
+    result.iter = _last_iter;
+    result.lat_error = _last_error;
+    rcp = test_instruction(inst_id, inst_spec, 1, alignment, false);
+    result.rcp_error = _last_error;
+
+    lat = std::max<double>(lat - overheadLat, 0);
+    rcp = std::max<double>(rcp - overheadRcp, 0);
+
+    // Latency of linked instructions includes the link, which was measured separately in the same run.
+    if (result.linked) {
+      double linkLat = std::max<double>(test_link(inst_id, inst_spec, alignment) - overheadLat, 0);
+      lat = std::max<double>(lat - linkLat, 0);
+    }
+  }
+
+  // Sweep the number of independent chains to find when the throughput saturates. The saturated value is
+  // used as a reciprocal throughput as the default parallel mode may not have enough chains to saturate it.
+  result.sat_chains = 0;
+  result.units = 0;
+
+  if (_app->sweep_chains() && _max_chains > 1) {
+    std::vector<double> chainRcp;
+    uint32_t maxChains = _max_chains;
+
+    for (uint32_t n = 1; n <= maxChains; n++) {
+      double chainResult = test_chains(inst_id, inst_spec, alignment, n);
+      if (chainResult < 0.0) {
+        maxChains = n - 1;
+        break;
+      }
+      chainRcp.push_back(std::max<double>(chainResult - overheadRcp, 0));
+    }
+
+    double bestRcp = chainRcp.empty() ? 0.0 : *std::min_element(chainRcp.begin(), chainRcp.end());
+    for (uint32_t n = 1; n <= maxChains; n++) {
+      if (chainRcp[n - 1] <= bestRcp * 1.05 + 0.01) {
+        result.sat_chains = n;
+        rcp = chainRcp[n - 1];
+        break;
+      }
+    }
+
+    // The saturating number of chains is the pipeline depth, which is the latency times the number of pipelined
+    // units. A unit that isn't fully pipelined saturates with fewer chains, so the result is a lower bound.
+    if (result.sat_chains && lat > 0.0)
+      result.units = std::max<uint32_t>(uint32_t(double(result.sat_chains) / lat + 0.5), 1u);
+  }
+
+  // Idioms are detected by comparing the regular latency with a latency of a same register chain.
+  result.idiom = _app->idioms() && is_idiom_candidate(Arch::kHost, inst_id, inst_spec);
+  result.move_candidate = _app->idioms() && is_move_candidate(inst_id, inst_spec);
+
+  result.idiom_lat = 0.0;
+  result.dep_breaking = false;
+  result.zero_idiom = false;
+  result.move_eliminated = false;
+
+  // The idiom fields are dropped if the same register form cannot be compiled.
+  double sameRegLat = result.idiom ? test_same_reg(inst_id, inst_spec, 0) : -1.0;
+  if (sameRegLat < 0.0)
+    result.idiom = false;
+
+  if (result.idiom) {
+    result.idiom_lat = std::max<double>(sameRegLat - overheadLat, 0);
+    result.dep_breaking = lat >= 0.75 && result.idiom_lat < lat * 0.6;
+    result.zero_idiom = result.dep_breaking && same_reg_result_is_zero(inst_id, inst_spec);
+  }
+
+  // A dependent chain of moves faster than a cycle per move cannot be executed by an execution unit.
+  if (result.move_candidate)
+    result.move_eliminated = lat < 0.75;
+
+  result.lat = lat;
+  result.rcp = rcp;
+
+  if (_clock)
+    result.freq_ratio = (ratioBefore + _clock->measure_ratio()) * 0.5;
+}
+
+// Returns how much a result would benefit from a precise measurement, lower values are refined first.
+//
+// Rounded results are only affected when the noise of a quick sample can move a value over a boundary of
+// `round_result()`, so the noise is subtracted from the distance to the boundary. Unrounded values are ordered by
+// their relative error, which includes a resolution of 0.01 cycles, so small values come first when the noise is
+// the same. Skewed results (throughput worse than latency) come first.
+double InstBench::refine_priority(const InstResult& result) const {
+  if (result.rcp > result.lat)
+    return -std::numeric_limits<double>::infinity();
+
+  if (!_app->_round) {
+    double latRelError = (result.lat_error + 0.01) / (result.lat + 0.01);
+    double rcpRelError = (result.rcp_error + 0.01) / (result.rcp + 0.01);
+    return -std::max(latRelError, rcpRelError);
+  }
+
+  return std::min(round_distance(result.lat) - result.lat_error,
+                  round_distance(result.rcp) - result.rcp_error);
+}
+
+void InstBench::emit_inst(const InstResult& result) {
+  JSONBuilder& json = _app->json();
+
+  StringTmp<256> sb;
+  inst_spec_name(sb, result.inst_id, result.inst_spec, result.alignment, result.show_alignment);
+
+  bool budgeted = _app->time_budget() > 0.0;
+
+  if (budgeted && !result.measured) {
+    if (_app->verbose())
+      printf("  %-40s: Skipped (time budget)\n", sb.data());
+
+    json.before_record()
+        .open_object()
+        .add_key("inst").add_string(sb.data()).align_to(54)
+        .add_key("skipped").add_bool(true)
+        .close_object();
+    return;
+  }
+
+  double lat = result.lat;
+  double rcp = result.rcp;
+  double idiomLat = result.idiom_lat;
+
+  // Results are in TSC cycles, which are converted to nanoseconds and to core cycles by the tracked ratio.
+  bool tracked = _app->track_freq() && result.freq_ratio > 0.0;
+  double latNs = 0.0;
+  double rcpNs = 0.0;
+
+  if (tracked) {
+    if (_tsc_freq) {
+      latNs = lat * 1e9 / double(_tsc_freq);
+      rcpNs = rcp * 1e9 / double(_tsc_freq);
+    }
+
+    lat *= result.freq_ratio;
+    rcp *= result.freq_ratio;
+    idiomLat *= result.freq_ratio;
+  }
+
+  if (_app->_round) {
+    lat = round_result(lat);
+    rcp = round_result(rcp);
+    idiomLat = round_result(idiomLat);
+  }
+
+  // Some tests are probably skewed. If this happens the latency is the throughput.
+  if (rcp > lat)
+    lat = rcp;
+
+  if (_app->verbose()) {
+    StringTmp<128> notes;
+
+    if (result.sat_chains)
+      notes.append_format(" Chains:%2u Units:%u", result.sat_chains, result.units);
+
+    if (result.linked)
+      notes.append(" (linked)");
+
+    if (result.zero_idiom)
+      notes.append(" (zero idiom)");
+    else if (result.dep_breaking)
+      notes.append(" (dependency breaking)");
+
+    if (result.move_eliminated)
+      notes.append(" (move eliminated)");
+
+    if (tracked)
+      notes.append_format(" Ratio:%5.3f", result.freq_ratio);
+
+    if (budgeted && !result.refined)
+      notes.append(" (quick)");
+
+    printf("  %-40s: Lat:%7.2f Rcp:%7.2f%s\n", sb.data(), lat, rcp, notes.data());
+  }
+
+  json.before_record()
+      .open_object()
+      .add_key("inst").add_string(sb.data()).align_to(54)
+      .add_key("lat").add_doublef("%7.2f", lat)
+      .add_key("rcp").add_doublef("%7.2f", rcp)
+      .add_key("iter").add_uint(result.iter);
+
+  if (result.linked)
+    json.add_key("latMethod").add_string("linked");
+
+  if (result.sat_chains) {
+    json.add_key("chains").add_uint(result.sat_chains)
+        .add_key("units").add_uint(result.units);
+  }
+
+  if (result.idiom) {
+    json.add_key("idiomLat").add_doublef("%7.2f", idiomLat)
+        .add_key("depBreaking").add_bool(result.dep_breaking)
+        .add_key("zeroIdiom").add_bool(result.zero_idiom);
+  }
+
+  if (result.move_candidate)
+    json.add_key("moveEliminated").add_bool(result.move_eliminated);
+
+  if (tracked) {
+    json.add_key("latNs").add_doublef("%8.3f", latNs)
+        .add_key("rcpNs").add_doublef("%8.3f", rcpNs)
+        .add_key("freqRatio").add_doublef("%5.3f", result.freq_ratio);
+  }
+
+  if (_app->unroll_fit())
+    json.add_key("fitResidual").add_doublef("%7.3f", result.fit_residual);
+
+  if (budgeted)
+    json.add_key("refined").add_bool(result.refined);
+
+  json.close_object();
+}
+
+void InstBench::run_addressing() {
+  JSONBuilder& json = _app->json();
+
+  if (_app->verbose())
+    printf("Addressing forms (latency, reciprocal throughput & load-to-use latency):\n");
+
+  json.before_record()
+      .add_key("addressing")
+      .open_array();
+
+  uint32_t instStart = 1;
+  uint32_t instEnd = x86::Inst::_kIdCount;
+
+  if (_app->_single_inst_id) {
+    instStart = _app->_single_inst_id;
+    instEnd = instStart + 1;
+  }
+
+  for (InstId inst_id = instStart; inst_id < instEnd; inst_id++) {
+    std::vector<InstSpec> specs;
+    classify(specs, inst_id);
+
+    for (size_t i = 0; i < specs.size(); i++) {
+      InstSpec inst_spec = specs[i];
+      if (!is_addr_candidate(inst_id, inst_spec))
+        continue;
+
+      StringTmp<256> sb;
+      inst_spec_name(sb, inst_id, inst_spec, 0, false);
+
+      // The overhead doesn't depend on the addressing form as base and index registers are initialized outside of the loop.
+      double overheadLat = test_instruction(inst_id, inst_spec, 0, 0, true);
+      double overheadRcp = test_instruction(inst_id, inst_spec, 1, 0, true);
+
+      for (uint32_t addr_mode = kAddrDefault + 1; addr_mode < kAddrCount; addr_mode++) {
+        if (!can_use_addr_mode(inst_id, inst_spec, addr_mode))
+          continue;
+
+        double lat = std::max<double>(test_addressing(inst_id, inst_spec, 0, addr_mode, false) - overheadLat, 0);
+        double rcp = std::max<double>(test_addressing(inst_id, inst_spec, 1, addr_mode, false) - overheadRcp, 0);
+
+        // RIP-relative address doesn't depend on a register, so it cannot form a load-to-use chain.
+        bool chase = addr_mode != kAddrRip && is_addr_chase_candidate(Arch::kHost, inst_id, inst_spec);
+        double loadToUse = 0.0;
+
+        if (chase)
+          loadToUse = std::max<double>(test_addressing(inst_id, inst_spec, 0, addr_mode, true) - overheadLat, 0);
+
+        if (_app->_round) {
+          lat = round_result(lat);
+          rcp = round_result(rcp);
+          loadToUse = round_result(loadToUse);
+        }
+
+        if (rcp > lat)
+          lat = rcp;
+
+        if (_app->verbose()) {
+          StringTmp<64> notes;
+          if (chase)
+            notes.append_format(" LoadToUse:%7.2f", loadToUse);
+
+          printf("  %-40s %-28s: Lat:%7.2f Rcp:%7.2f%s\n", sb.data(), addr_mode_name(addr_mode), lat, rcp, notes.data());
+        }
+
+        json.before_record()
+            .open_object()
+            .add_key("inst").add_string(sb.data()).align_to(54)
+            .add_key("addr").add_string(addr_mode_name(addr_mode)).align_to(94)
+            .add_key("lat").add_doublef("%7.2f", lat)
+            .add_key("rcp").add_doublef("%7.2f", rcp);
+
+        if (chase)
+          json.add_key("loadToUse").add_doublef("%7.2f", loadToUse);
+
+        json.close_object();
+      }
+    }
+  }
+
+  if (_app->verbose())
+    printf("\n");
+
+  json.close_array(true);
+}
+
+void InstBench::run_all_core() {
+  JSONBuilder& json = _app->json();
+
+  std::vector<uint32_t> cpus = SchedUtils::allowed_cpus();
+  if (cpus.size() > 64u)
+    cpus.resize(64u);
+
+  // Powers of two and all CPUs, each thread count takes kAllCoreCalls calls of every thread.
+  uint32_t maxThreads = uint32_t(cpus.size());
+
+  std::vector<uint32_t> thread_counts;
+  for (uint32_t n = 1; n < maxThreads; n *= 2)
+    thread_counts.push_back(n);
+  thread_counts.push_back(maxThreads);
+
+  std::vector<InstId> insts;
+  if (_app->_single_inst_id)
+    insts.push_back(_app->_single_inst_id);
+  else
+    insts.assign(std::begin(all_core_default_insts), std::end(all_core_default_insts));
+
+  if (_app->verbose())
+    printf("All-core throughput (reciprocal throughput per core & aggregate instructions per cycle):\n");
 
-      for (uint32_t alignment : alignments) {
-        StringTmp<256> sb;
-        if (inst_id == x86::Inst::kIdCall) {
-          sb.append("call+ret");
-        }
-        else {
-          InstAPI::inst_id_to_string(Arch::kHost, inst_id, InstStringifyOptions::kNone, sb);
-        }
+  json.before_record()
+      .add_key("allCore")
+      .open_array();
 
-        for (uint32_t i = 0; i < op_count; i++) {
-          if (i == 0)
-            sb.append(' ');
-          else if (inst_id == x86::Inst::kIdLea)
-            sb.append(i == 1 ? ", [" : " + ");
-          else
-            sb.append(", ");
+  for (InstId inst_id : insts) {
+    std::vector<InstSpec> specs;
+    classify(specs, inst_id);
 
-          sb.append(inst_spec_op_as_string(inst_spec.get(i)));
+    for (size_t i = 0; i < specs.size(); i++) {
+      InstSpec inst_spec = specs[i];
 
-          if (i == 0 && (is_gather_inst(inst_id) || is_scatter_inst(inst_id)) && op_count == 2) {
-            sb.append(" {k}");
-          }
+      // Memory operands use the stack of each thread, but register forms are enough to load execution units.
+      if (inst_spec.mem_op() || inst_spec.has_modifiers() || inst_spec.is_lock())
+        continue;
 
-          if (i == 2 && inst_spec.is_lea_scale())
-            sb.append(" * N");
+      StringTmp<256> sb;
+      inst_spec_name(sb, inst_id, inst_spec, 0, false);
 
-          if (inst_id == x86::Inst::kIdLea && i == op_count - 1)
-            sb.append(']');
+      double overheadRcp = test_instruction(inst_id, inst_spec, 1, 0, true);
+      double singleIpc = 0.0;
 
-          if (alignments.size() != 1) {
-            if (InstSpec::is_mem_op(inst_spec.get(i)) || InstSpec::is_vm_op(inst_spec.get(i))) {
-              if (alignment == 0)
-                sb.append(" {a}");
-              else
-                sb.append(" {u}");
-            }
-          }
-        }
+      for (uint32_t thread_count : thread_counts) {
+        double threadRcp = test_all_core(inst_id, inst_spec, cpus, thread_count);
+        if (threadRcp < 0.0)
+          continue;
 
-        double overheadLat = test_instruction(inst_id, inst_spec, 0, alignment, true);
-        double overheadRcp = test_instruction(inst_id, inst_spec, 1, alignment, true);
+        double rcp = std::max<double>(threadRcp - overheadRcp, 0);
+        double ipc = rcp > 0.0 ? double(thread_count) / rcp : 0.0;
 
-        double lat = test_instruction(inst_id, inst_spec, 0, alignment, false);
-        double rcp = test_instruction(inst_id, inst_spec, 1, alignment, false);
+        if (thread_count == 1)
+          singleIpc = ipc;
 
-        lat = std::max<double>(lat - overheadLat, 0);
-        rcp = std::max<double>(rcp - overheadRcp, 0);
+        double scaling = singleIpc > 0.0 ? ipc / (singleIpc * double(thread_count)) : 0.0;
 
-        if (_app->_round) {
-          lat = round_result(lat);
+        if (_app->_round)
           rcp = round_result(rcp);
-        }
-
-        // Some tests are probably skewed. If this happens the latency is the throughput.
-        if (rcp > lat)
-          lat = rcp;
 
         if (_app->verbose())
-          printf("  %-40s: Lat:%7.2f Rcp:%7.2f\n", sb.data(), lat, rcp);
+          printf("  %-40s Threads:%-3u: Rcp:%7.2f IPC:%8.2f Scaling:%5.2f\n", sb.data(), thread_count, rcp, ipc, scaling);
 
         json.before_record()
             .open_object()
             .add_key("inst").add_string(sb.data()).align_to(54)
-            .add_key("lat").add_doublef("%7.2f", lat)
+            .add_key("threads").add_uint(thread_count)
             .add_key("rcp").add_doublef("%7.2f", rcp)
+            .add_key("ipc").add_doublef("%8.2f", ipc)
+            .add_key("scaling").add_doublef("%5.2f", scaling)
             .close_object();
       }
     }
@@ -711,9 +1609,6 @@ void InstBench::run() {
 void InstBench::classify(std::vector<InstSpec>& dst, InstId inst_id) {
   using namespace asmjit;
 
-  if (is_ignored_inst(inst_id))
-    return;
-
   // Special cases.
   if (inst_id == x86::Inst::kIdCpuid    ||
       inst_id == x86::Inst::kIdEmms     ||
@@ -914,6 +1809,56 @@ void InstBench::classify(std::vector<InstSpec>& dst, InstId inst_id) {
               known.insert(inst_spec);
               dst.push_back(inst_spec);
             }
+
+            // Read-modify-write instructions with a memory destination are also benchmarked with LOCK prefix, the
+            // memory is not shared with other threads, so it's the uncontended cost of an atomic operation.
+            if (!vec && InstSpec::is_mem_op(inst_spec.get(0))) {
+              InstSpec variant = inst_spec.with_flags(InstSpec::kLock);
+              if (_can_run(inst_spec_to_base_inst(inst_id, variant), operands, op_count) && known.find(variant) == known.end()) {
+                known.insert(variant);
+                dst.push_back(variant);
+              }
+            }
+
+            // AVX-512 modifiers form separate specs, each of them is only used if the instruction accepts it. Gathers
+            // and scatters always use a mask, which is initialized by their kernels in compile_body().
+            if (_app->modifiers() && vec && x86_features().has_avx512_f() && !is_gather_inst(inst_id) && !is_scatter_inst(inst_id)) {
+              static const uint32_t modifier_flags[] = {
+                InstSpec::kMaskMerge,
+                InstSpec::kMaskZero,
+                InstSpec::kBcst32,
+                InstSpec::kBcst64,
+                InstSpec::kBcst16,
+                InstSpec::kRoundingSae
+              };
+
+              uint32_t mem_op = inst_spec.mem_op();
+              bool has_bcst = false;
+
+              for (uint32_t flags : modifier_flags) {
+                // Only a single broadcast element size matches the instruction, rounding requires register operands.
+                if ((flags & InstSpec::kBcstFlags) && (has_bcst || !InstSpec::is_mem_op(mem_op)))
+                  continue;
+
+                if (flags == InstSpec::kRoundingSae && mem_op != InstSpec::kOpNone)
+                  continue;
+
+                InstSpec variant = inst_spec.with_flags(flags);
+                Operand variant_operands[6] {};
+                inst_spec_to_operand_array(Arch::kHost, variant_operands, variant);
+
+                if (!_can_run(inst_spec_to_base_inst(inst_id, variant), variant_operands, op_count))
+                  continue;
+
+                if (known.find(variant) == known.end()) {
+                  known.insert(variant);
+                  dst.push_back(variant);
+                }
+
+                if (flags & InstSpec::kBcstFlags)
+                  has_bcst = true;
+              }
+            }
           }
         }
       }
@@ -955,71 +1900,307 @@ bool InstBench::_can_run(const BaseInst& inst, const Operand_* operands, uint32_
   return true;
 }
 
-uint32_t InstBench::num_iter_by_inst_id(InstId inst_id) const {
-  switch (inst_id) {
-    // Return low number for instructions that are really slow.
-    case x86::Inst::kIdCpuid:
-    case x86::Inst::kIdRdrand:
-    case x86::Inst::kIdRdseed:
-      return 4;
+// Returns the number of iterations that makes a single sample of `func` take about `kTargetSampleCycles`.
+//
+// The cost of an iteration is the difference between 1 and 5 iterations, which removes the fixed cost of the call
+// and of reading the timestamp counter. Both are the best of a few calls.
+uint32_t InstBench::calibrate_iter(Func func) {
+  uint64_t c1 = std::numeric_limits<uint64_t>::max();
+  uint64_t c5 = std::numeric_limits<uint64_t>::max();
 
-    default:
-      return 160;
+  for (uint32_t i = 0; i < kCalibrationCalls; i++) {
+    uint64_t n;
+
+    func(1, &n);
+    c1 = std::min(c1, n);
+
+    func(5, &n);
+    c5 = std::min(c5, n);
   }
+
+  double perIter = c5 > c1 ? double(c5 - c1) / 4.0 : double(c5) / 5.0;
+  double nIter = perIter > 0.0 ? double(kTargetSampleCycles) / perIter : double(kMaxIterCount);
+
+  return uint32_t(std::min<double>(std::max<double>(nIter, 1.0), double(kMaxIterCount)));
 }
 
-double InstBench::test_instruction(InstId inst_id, InstSpec inst_spec, uint32_t parallel, uint32_t mem_alignment, bool overhead_only) {
+InstBench::Func InstBench::compile_instruction(InstId inst_id, InstSpec inst_spec, uint32_t parallel, uint32_t mem_alignment, bool overhead_only) {
   _inst_id = inst_id;
   _inst_spec = inst_spec;
   _n_parallel = parallel ? 6 : 1;
   _overhead_only = overhead_only;
   _mem_alignment = mem_alignment;
+  _link_kind = _addr_mode == kAddrDefault ? link_kind_of(Arch::kHost, inst_id, inst_spec) : uint32_t(kLinkNone);
 
   Func func = compile_func();
+
+  // The instruction cannot be encoded with the registers available, which only happens in chain sweeps.
+  if (_fill_failed) {
+    if (func)
+      release_func(func);
+    return nullptr;
+  }
+
   if (!func) {
     String name;
     InstAPI::inst_id_to_string(Arch::kHost, inst_id, InstStringifyOptions::kNone, name);
     printf("FAILED to compile function for '%s' instruction\n", name.data());
-    return -1.0;
   }
 
-  uint32_t nIter = num_iter_by_inst_id(_inst_id);
+  return func;
+}
+
+double InstBench::test_instruction(InstId inst_id, InstSpec inst_spec, uint32_t parallel, uint32_t mem_alignment, bool overhead_only) {
+  Func func = compile_instruction(inst_id, inst_spec, parallel, mem_alignment, overhead_only);
+  if (!func)
+    return -1.0;
 
-  // Consider a significant improvement 0.05 cycles per instruction (0.2 cycles in fast mode).
-  uint32_t kSignificantImprovement = uint32_t(double(nIter) * (_app->_estimate ? 0.25 : 0.04));
+  uint32_t nIter = calibrate_iter(func);
+  uint64_t best = measure_best(func, nIter);
+  _last_iter = nIter;
+  _last_error = _last_spread / double(nIter * _n_unroll);
 
-  // If we called the function N times without a significant improvement we terminate the test.
-  uint32_t kMaximumImprovementTries = _app->_estimate ? 1000 : 50000;
+  release_func(func);
+  return double(best) / (double(nIter * _n_unroll));
+}
 
-  constexpr uint32_t kMaxIterationCount = 5000000;
+// Runs the parallel form of the instruction on `thread_count` threads pinned to the first `cpus` at the same time
+// and returns the average reciprocal throughput of a single thread, or a negative value on failure.
+double InstBench::test_all_core(InstId inst_id, InstSpec inst_spec, const std::vector<uint32_t>& cpus, uint32_t thread_count) {
+  Func func = compile_instruction(inst_id, inst_spec, 1, 0, false);
+  if (!func)
+    return -1.0;
 
-  uint64_t best;
-  func(nIter, &best);
+  uint32_t nIter = calibrate_iter(func);
+  uint32_t nCalls = _app->_estimate ? kAllCoreCalls / 20u : kAllCoreCalls;
 
-  uint64_t previousBest = best;
-  uint32_t improvementTries = 0;
+  std::vector<AllCoreThread> threads(thread_count);
+  std::vector<std::thread> workers;
+  std::atomic<uint32_t> arrived(0);
+  std::atomic<uint32_t> finished(0);
 
-  for (uint32_t i = 0; i < kMaxIterationCount; i++) {
-    uint64_t n;
-    func(nIter, &n);
+  for (uint32_t i = 0; i < thread_count; i++)
+    threads[i] = AllCoreThread { func, cpus[i], nIter, nCalls, 0, false };
 
-    best = std::min(best, n);
-    if (n < previousBest) {
-      if (previousBest - n >= kSignificantImprovement) {
-        previousBest = n;
-        improvementTries = 0;
-      }
+  for (uint32_t i = 0; i < thread_count; i++)
+    workers.emplace_back(all_core_thread_main, &threads[i], &arrived, &finished, thread_count);
+
+  for (std::thread& worker : workers)
+    worker.join();
+
+  release_func(func);
+
+  double sum = 0.0;
+  for (const AllCoreThread& t : threads) {
+    if (!t.pinned) {
+      printf("FAILED to pin thread to CPU %u\n", t.cpu);
+      return -1.0;
     }
-    else {
-      improvementTries++;
+    sum += double(t.best) / (double(nIter * _n_unroll));
+  }
+
+  return sum / double(thread_count);
+}
+
+// Measures the kernel with different unroll counts and fits `cycles = a + b * n` to cycles per iteration. The slope
+// `b` is the cost of a single instruction and the intercept `a` is the cost of the loop. The residual is the root
+// mean square error of the fit divided by the average unroll count, so it's comparable to the slope.
+InstBench::InstFit InstBench::fit_instruction(InstId inst_id, InstSpec inst_spec, uint32_t parallel, uint32_t mem_alignment, bool overhead_only) {
+  constexpr uint32_t kCount = uint32_t(sizeof(fit_unroll_counts) / sizeof(fit_unroll_counts[0]));
+
+  uint32_t savedUnroll = _n_unroll;
+  double x[kCount];
+  double y[kCount];
+
+  for (uint32_t i = 0; i < kCount; i++) {
+    _n_unroll = fit_unroll_counts[i];
+
+    Func func = compile_instruction(inst_id, inst_spec, parallel, mem_alignment, overhead_only);
+    if (!func) {
+      _n_unroll = savedUnroll;
+      return InstFit { -1.0, 0.0, 0.0 };
     }
 
-    if (improvementTries >= kMaximumImprovementTries)
-      break;
+    uint32_t nIter = calibrate_iter(func);
+    uint64_t best = measure_best(func, nIter);
+    _last_iter = nIter;
+    release_func(func);
+
+    x[i] = double(_n_unroll);
+    y[i] = double(best) / double(nIter);
   }
 
-  release_func(func);
-  return double(best) / (double(nIter * _n_unroll));
+  _n_unroll = savedUnroll;
+
+  double mx = 0.0;
+  double my = 0.0;
+
+  for (uint32_t i = 0; i < kCount; i++) {
+    mx += x[i];
+    my += y[i];
+  }
+
+  mx /= double(kCount);
+  my /= double(kCount);
+
+  double sxy = 0.0;
+  double sxx = 0.0;
+
+  for (uint32_t i = 0; i < kCount; i++) {
+    sxy += (x[i] - mx) * (y[i] - my);
+    sxx += (x[i] - mx) * (x[i] - mx);
+  }
+
+  InstFit fit;
+  fit.slope = sxy / sxx;
+  fit.intercept = my - fit.slope * mx;
+
+  double sse = 0.0;
+  for (uint32_t i = 0; i < kCount; i++) {
+    double e = y[i] - (fit.intercept + fit.slope * x[i]);
+    sse += e * e;
+  }
+
+  fit.residual = std::sqrt(sse / double(kCount)) / mx;
+  return fit;
+}
+
+double InstBench::test_chains(InstId inst_id, InstSpec inst_spec, uint32_t mem_alignment, uint32_t n_chains) {
+  _n_chains = n_chains;
+  double rcp = test_instruction(inst_id, inst_spec, 1, mem_alignment, false);
+  _n_chains = 0;
+
+  return rcp;
+}
+
+double InstBench::test_same_reg(InstId inst_id, InstSpec inst_spec, uint32_t parallel) {
+  _same_reg = true;
+  double result = test_instruction(inst_id, inst_spec, parallel, 0, false);
+  _same_reg = false;
+
+  return result;
+}
+
+bool InstBench::same_reg_result_is_zero(InstId inst_id, InstSpec inst_spec) {
+  FileLogger logger(stdout);
+  CodeHolder code;
+
+  code.init(_runtime.environment());
+  if (_app->dump())
+    code.set_logger(&logger);
+
+  x86::Assembler a(&code);
+
+  FuncDetail fd;
+  fd.init(FuncSignature::build<void, void*>(CallConvId::kCDecl), code.environment());
+
+  FuncFrame frame;
+  frame.init(fd);
+  frame.set_all_dirty(RegGroup::kGp);
+  frame.set_all_dirty(RegGroup::kVec);
+
+  x86::Gp data = a.zsi();
+  FuncArgsAssignment args(&fd);
+  args.assign_all(data);
+  args.update_func_frame(frame);
+  frame.finalize();
+
+  a.emit_prolog(frame);
+  a.emit_args_assignment(frame, args);
+
+  // Load a non-zero pattern to the register, execute the instruction with the same register in all operands,
+  // and store the register back so the result can be checked.
+  const x86::InstDB::InstInfo& inst_info = x86::InstDB::inst_info_by_id(inst_id);
+  bool vex = inst_info.is_vex_or_evex();
+  Reg reg;
+
+  // K registers are stored by KMOVQ if available (AVX512_BW), otherwise only their low 16 bits are stored.
+  bool kmovq = x86_features().has_avx512_bw();
+
+  switch (inst_spec.get(0)) {
+    case InstSpec::kOpGpb: reg = x86::cl; a.mov(x86::cl, x86::ptr(data)); break;
+    case InstSpec::kOpGpw: reg = x86::cx; a.mov(x86::cx, x86::ptr(data)); break;
+    case InstSpec::kOpGpd: reg = x86::ecx; a.mov(x86::ecx, x86::ptr(data)); break;
+    case InstSpec::kOpGpq: reg = x86::rcx; a.mov(x86::rcx, x86::ptr(data)); break;
+    case InstSpec::kOpMm : reg = x86::mm1; a.movq(x86::mm1, x86::ptr(data)); break;
+    case InstSpec::kOpXmm: reg = x86::xmm1; if (vex) a.vmovdqu(x86::xmm1, x86::ptr(data)); else a.movdqu(x86::xmm1, x86::ptr(data)); break;
+    case InstSpec::kOpYmm: reg = x86::ymm1; a.vmovdqu(x86::ymm1, x86::ptr(data)); break;
+    case InstSpec::kOpZmm: reg = x86::zmm1; a.vmovdqu64(x86::zmm1, x86::ptr(data)); break;
+    case InstSpec::kOpKReg: reg = x86::k1; if (kmovq) a.kmovq(x86::k1, x86::ptr(data)); else a.kmovw(x86::k1, x86::ptr(data)); break;
+    default:
+      return false;
+  }
+
+  Operand ops[3] = { reg, reg, reg };
+  a.emit_op_array(inst_id, ops, inst_spec.count());
+
+  switch (inst_spec.get(0)) {
+    case InstSpec::kOpGpb: a.mov(x86::ptr(data), x86::cl); break;
+    case InstSpec::kOpGpw: a.mov(x86::ptr(data), x86::cx); break;
+    case InstSpec::kOpGpd: a.mov(x86::ptr(data), x86::ecx); break;
+    case InstSpec::kOpGpq: a.mov(x86::ptr(data), x86::rcx); break;
+    case InstSpec::kOpMm : a.movq(x86::ptr(data), x86::mm1); a.emms(); break;
+    case InstSpec::kOpXmm: if (vex) a.vmovdqu(x86::ptr(data), x86::xmm1); else a.movdqu(x86::ptr(data), x86::xmm1); break;
+    case InstSpec::kOpYmm: a.vmovdqu(x86::ptr(data), x86::ymm1); a.vzeroupper(); break;
+    case InstSpec::kOpZmm: a.vmovdqu64(x86::ptr(data), x86::zmm1); a.vzeroupper(); break;
+    case InstSpec::kOpKReg: if (kmovq) a.kmovq(x86::ptr(data), x86::k1); else a.kmovw(x86::ptr(data), x86::k1); break;
+  }
+
+  a.emit_epilog(frame);
+  code.detach(&a);
+
+  typedef void (*ProbeFunc)(void* data);
+  ProbeFunc func;
+
+  if (_runtime.add(&func, &code) != kErrorOk)
+    return false;
+
+  uint8_t data_buffer[64];
+  for (uint32_t i = 0; i < 64; i++)
+    data_buffer[i] = uint8_t(0xA5u + i * 7u);
+
+  func(data_buffer);
+  _runtime.release(func);
+
+  // Only the part of the register that was stored is checked.
+  uint32_t size = inst_spec.get(0) == InstSpec::kOpKReg ? (kmovq ? 8u : 2u) : reg.size();
+  for (uint32_t i = 0; i < size; i++)
+    if (data_buffer[i] != 0)
+      return false;
+
+  return true;
+}
+
+double InstBench::test_link(InstId inst_id, InstSpec inst_spec, uint32_t mem_alignment) {
+  _link_only = true;
+  double lat = test_instruction(inst_id, inst_spec, 0, mem_alignment, false);
+  _link_only = false;
+
+  return lat;
+}
+
+double InstBench::test_addressing(InstId inst_id, InstSpec inst_spec, uint32_t parallel, uint32_t addr_mode, bool chase) {
+  _addr_mode = addr_mode;
+  _addr_chase = chase;
+  double result = test_instruction(inst_id, inst_spec, parallel, 0, false);
+  _addr_mode = kAddrDefault;
+  _addr_chase = false;
+
+  return result;
+}
+
+bool InstBench::can_use_addr_mode(InstId inst_id, InstSpec inst_spec, uint32_t addr_mode) {
+  switch (addr_mode) {
+    case kAddrRip:
+      // The memory is embedded in the code, which is not writable.
+      return is_64bit() && !is_mem_written(Arch::kHost, inst_id, inst_spec);
+
+    case kAddr32:
+      return is_64bit() && ensure_addr32_data() != nullptr;
+
+    default:
+      return true;
+  }
 }
 
 void InstBench::before_body(x86::Assembler& a) {
@@ -1106,6 +2287,18 @@ void InstBench::compile_body(x86::Assembler& a, x86::Gp reg_cnt) {
   reg_mask[uint32_t(RegGroup::kMask)] = 0xFE;
   reg_mask[uint32_t(RegGroup::kX86_MM)] = 0xFF;
 
+  // K7 is used to consume mask registers in sequential mode, so it cannot be a part of a K register pair.
+  if (inst_id == x86::Inst::kIdVp2intersectd || inst_id == x86::Inst::kIdVp2intersectq)
+    reg_mask[uint32_t(RegGroup::kMask)] &= ~Support::bit_mask<RegMask>(7);
+
+  // K1 is a mask of AVX-512 masked instructions.
+  if (_inst_spec.is_masked())
+    reg_mask[uint32_t(RegGroup::kMask)] &= ~Support::bit_mask<RegMask>(1);
+
+  // Base and index registers of addressing forms cannot be used by the instruction.
+  if (_addr_mode != kAddrDefault)
+    reg_mask[uint32_t(RegGroup::kGp)] &= ~Support::bit_mask<RegMask>(x86::Gp::kIdSi, x86::Gp::kIdDi);
+
   x86::Gp gs_base;
   x86::Vec gathereg_mask;
 
@@ -1183,8 +2376,43 @@ void InstBench::compile_body(x86::Assembler& a, x86::Gp reg_cnt) {
     }
   }
 
+  // Parallel mode uses all available registers unless the number of independent chains was specified. Instructions
+  // with more register operands need extra registers to form the same number of chains, see the patterns below.
+  //
+  // Registers are counted and limited in whole groups when an operand occupies consecutive registers.
+  if (is_parallel) {
+    uint32_t chain_extra = regCount <= 1 ? 0u : regCount <= 3 ? 1u : 2u;
+    uint32_t group = rotated_reg_group(_inst_spec.get(0));
+
+    uint32_t group_size[32];
+    for (uint32_t g = 0; g < 32; g++)
+      group_size[g] = 1;
+
+    for (i = 0; i < op_count; i++) {
+      uint32_t g = rotated_reg_group(_inst_spec.get(i));
+      if (g != 0xFFFFFFFFu)
+        group_size[g] = std::max(group_size[g], consecutive_reg_count(inst_id, i));
+    }
+
+    _max_chains = 0;
+    if (group != 0xFFFFFFFFu) {
+      uint32_t available = count_reg_groups(reg_mask[group], group_size[group]);
+      _max_chains = available > chain_extra ? available - chain_extra : 0u;
+    }
+
+    if (_n_chains) {
+      for (uint32_t g = 0; g < 32; g++)
+        if (reg_mask[g])
+          reg_mask[g] = limit_reg_mask(reg_mask[g], _n_chains + chain_extra, group_size[g]);
+    }
+  }
+
+  // Register limits of chain sweeps may leave no register (or register group) for an operand.
+  bool filled = true;
+  _fill_failed = false;
+
   if (is_gather_avx512 || is_scatter_avx512) {
-    fillRegArray(ox, _n_unroll, 1, is_parallel ? 1 : 0, reg_mask[uint32_t(RegGroup::kMask)], RegTraits<RegType::kMask>::kSignature);
+    filled &= fillRegArray(ox, _n_unroll, 1, is_parallel ? 1 : 0, reg_mask[uint32_t(RegGroup::kMask)], RegTraits<RegType::kMask>::kSignature);
   }
   else if (is_gather) {
     // Don't count mask in AVX2 gather case.
@@ -1202,6 +2430,7 @@ void InstBench::compile_body(x86::Assembler& a, x86::Gp reg_cnt) {
 
     uint32_t rStart = 0;
     uint32_t rInc = 1;
+    uint32_t rGroup = consecutive_reg_count(inst_id, i);
 
     switch (regCount) {
       // Patterns we want to generate:
@@ -1312,17 +2541,17 @@ void InstBench::compile_body(x86::Assembler& a, x86::Gp reg_cnt) {
       case InstSpec::kOpRbx   : fillOpArray(dst, _n_unroll, x86::rbx); break;
       case InstSpec::kOpRcx   : fillOpArray(dst, _n_unroll, x86::rcx); break;
       case InstSpec::kOpRdx   : fillOpArray(dst, _n_unroll, x86::rdx); break;
-      case InstSpec::kOpGpb   : fillRegArray(dst, _n_unroll, rStart, rInc, reg_mask[uint32_t(RegGroup::kGp)], RegTraits<RegType::kGp8Lo>::kSignature); break;
-      case InstSpec::kOpGpw   : fillRegArray(dst, _n_unroll, rStart, rInc, reg_mask[uint32_t(RegGroup::kGp)], RegTraits<RegType::kGp16>::kSignature); break;
-      case InstSpec::kOpGpd   : fillRegArray(dst, _n_unroll, rStart, rInc, reg_mask[uint32_t(RegGroup::kGp)], RegTraits<RegType::kGp32>::kSignature); break;
-      case InstSpec::kOpGpq   : fillRegArray(dst, _n_unroll, rStart, rInc, reg_mask[uint32_t(RegGroup::kGp)], RegTraits<RegType::kGp64>::kSignature); break;
+      case InstSpec::kOpGpb   : filled &= fillRegArray(dst, _n_unroll, rStart, rInc, reg_mask[uint32_t(RegGroup::kGp)], RegTraits<RegType::kGp8Lo>::kSignature); break;
+      case InstSpec::kOpGpw   : filled &= fillRegArray(dst, _n_unroll, rStart, rInc, reg_mask[uint32_t(RegGroup::kGp)], RegTraits<RegType::kGp16>::kSignature); break;
+      case InstSpec::kOpGpd   : filled &= fillRegArray(dst, _n_unroll, rStart, rInc, reg_mask[uint32_t(RegGroup::kGp)], RegTraits<RegType::kGp32>::kSignature); break;
+      case InstSpec::kOpGpq   : filled &= fillRegArray(dst, _n_unroll, rStart, rInc, reg_mask[uint32_t(RegGroup::kGp)], RegTraits<RegType::kGp64>::kSignature); break;
 
       case InstSpec::kOpXmm0  : fillOpArray(dst, _n_unroll, x86::xmm0); break;
-      case InstSpec::kOpXmm   : fillRegArray(dst, _n_unroll, rStart, rInc, reg_mask[uint32_t(RegGroup::kVec)], RegTraits<RegType::kVec128>::kSignature); break;
-      case InstSpec::kOpYmm   : fillRegArray(dst, _n_unroll, rStart, rInc, reg_mask[uint32_t(RegGroup::kVec)], RegTraits<RegType::kVec256>::kSignature); break;
-      case InstSpec::kOpZmm   : fillRegArray(dst, _n_unroll, rStart, rInc, reg_mask[uint32_t(RegGroup::kVec)], RegTraits<RegType::kVec512>::kSignature); break;
-      case InstSpec::kOpKReg  : fillRegArray(dst, _n_unroll, rStart, rInc, reg_mask[uint32_t(RegGroup::kMask)], RegTraits<RegType::kMask>::kSignature); break;
-      case InstSpec::kOpMm    : fillRegArray(dst, _n_unroll, rStart, rInc, reg_mask[uint32_t(RegGroup::kX86_MM)], RegTraits<RegType::kX86_Mm >::kSignature); break;
+      case InstSpec::kOpXmm   : filled &= fillRegArray(dst, _n_unroll, rStart, rInc, reg_mask[uint32_t(RegGroup::kVec)], RegTraits<RegType::kVec128>::kSignature, rGroup); break;
+      case InstSpec::kOpYmm   : filled &= fillRegArray(dst, _n_unroll, rStart, rInc, reg_mask[uint32_t(RegGroup::kVec)], RegTraits<RegType::kVec256>::kSignature, rGroup); break;
+      case InstSpec::kOpZmm   : filled &= fillRegArray(dst, _n_unroll, rStart, rInc, reg_mask[uint32_t(RegGroup::kVec)], RegTraits<RegType::kVec512>::kSignature, rGroup); break;
+      case InstSpec::kOpKReg  : filled &= fillRegArray(dst, _n_unroll, rStart, rInc, reg_mask[uint32_t(RegGroup::kMask)], RegTraits<RegType::kMask>::kSignature, rGroup); break;
+      case InstSpec::kOpMm    : filled &= fillRegArray(dst, _n_unroll, rStart, rInc, reg_mask[uint32_t(RegGroup::kX86_MM)], RegTraits<RegType::kX86_Mm >::kSignature); break;
 
       case InstSpec::kOpImm8  : fillImmArray(dst, _n_unroll, 0, 1    , 15        ); break;
       case InstSpec::kOpImm16 : fillImmArray(dst, _n_unroll, 1, 13099, 65535     ); break;
@@ -1337,12 +2566,60 @@ void InstBench::compile_body(x86::Assembler& a, x86::Gp reg_cnt) {
       case InstSpec::kOpMem256: fillMemArray(dst, _n_unroll, x86::ymmword_ptr(a.zsp(), misalignment), is_parallel ? 32 : 0); break;
       case InstSpec::kOpMem512: fillMemArray(dst, _n_unroll, x86::zmmword_ptr(a.zsp(), misalignment), is_parallel ? 64 : 0); break;
 
-      case InstSpec::kOpVm32x : fillRegArray(dst, _n_unroll, rStart, rInc, reg_mask[uint32_t(RegGroup::kVec)], RegTraits<RegType::kVec128>::kSignature); break;
-      case InstSpec::kOpVm32y : fillRegArray(dst, _n_unroll, rStart, rInc, reg_mask[uint32_t(RegGroup::kVec)], RegTraits<RegType::kVec256>::kSignature); break;
-      case InstSpec::kOpVm32z : fillRegArray(dst, _n_unroll, rStart, rInc, reg_mask[uint32_t(RegGroup::kVec)], RegTraits<RegType::kVec512>::kSignature); break;
-      case InstSpec::kOpVm64x : fillRegArray(dst, _n_unroll, rStart, rInc, reg_mask[uint32_t(RegGroup::kVec)], RegTraits<RegType::kVec128>::kSignature); break;
-      case InstSpec::kOpVm64y : fillRegArray(dst, _n_unroll, rStart, rInc, reg_mask[uint32_t(RegGroup::kVec)], RegTraits<RegType::kVec256>::kSignature); break;
-      case InstSpec::kOpVm64z : fillRegArray(dst, _n_unroll, rStart, rInc, reg_mask[uint32_t(RegGroup::kVec)], RegTraits<RegType::kVec512>::kSignature); break;
+      case InstSpec::kOpVm32x : filled &= fillRegArray(dst, _n_unroll, rStart, rInc, reg_mask[uint32_t(RegGroup::kVec)], RegTraits<RegType::kVec128>::kSignature); break;
+      case InstSpec::kOpVm32y : filled &= fillRegArray(dst, _n_unroll, rStart, rInc, reg_mask[uint32_t(RegGroup::kVec)], RegTraits<RegType::kVec256>::kSignature); break;
+      case InstSpec::kOpVm32z : filled &= fillRegArray(dst, _n_unroll, rStart, rInc, reg_mask[uint32_t(RegGroup::kVec)], RegTraits<RegType::kVec512>::kSignature); break;
+      case InstSpec::kOpVm64x : filled &= fillRegArray(dst, _n_unroll, rStart, rInc, reg_mask[uint32_t(RegGroup::kVec)], RegTraits<RegType::kVec128>::kSignature); break;
+      case InstSpec::kOpVm64y : filled &= fillRegArray(dst, _n_unroll, rStart, rInc, reg_mask[uint32_t(RegGroup::kVec)], RegTraits<RegType::kVec256>::kSignature); break;
+      case InstSpec::kOpVm64z : filled &= fillRegArray(dst, _n_unroll, rStart, rInc, reg_mask[uint32_t(RegGroup::kVec)], RegTraits<RegType::kVec512>::kSignature); break;
+    }
+  }
+
+  if (!filled) {
+    _fill_failed = true;
+
+    ::free(o0);
+    ::free(o1);
+    ::free(o2);
+    ::free(o3);
+    ::free(o4);
+    ::free(o5);
+    return;
+  }
+
+  // Addressing mode sweep replaces all memory operands by the selected addressing form.
+  if (_addr_mode != kAddrDefault) {
+    Operand* ops[6] = { o0, o1, o2, o3, o4, o5 };
+    _addr_label = a.new_label();
+
+    for (i = 0; i < op_count; i++) {
+      if (InstSpec::is_mem_op(_inst_spec.get(i))) {
+        for (uint32_t n = 0; n < _n_unroll; n++)
+          ops[i][n] = addr_mem(a, ops[i][n].as<x86::Mem>().size(), n, is_parallel);
+      }
+    }
+  }
+
+  // Embedded broadcast replaces memory operands by broadcasts of a single element.
+  if (_inst_spec.bcst_size()) {
+    Operand* ops[6] = { o0, o1, o2, o3, o4, o5 };
+
+    for (i = 0; i < op_count; i++) {
+      if (InstSpec::is_mem_op(_inst_spec.get(i))) {
+        for (uint32_t n = 0; n < _n_unroll; n++)
+          ops[i][n] = bcst_mem(ops[i][n].as<x86::Mem>(), mem_op_size(_inst_spec.get(i)), _inst_spec.bcst_size());
+      }
+    }
+  }
+
+  // Idiom mode uses the same register in all operands, which are guaranteed to be of the same kind.
+  if (_same_reg) {
+    for (i = 0; i < _n_unroll; i++) {
+      Operand reg = is_parallel ? o0[i] : o0[0];
+      o0[i] = reg;
+      o1[i] = reg;
+      if (op_count > 2)
+        o2[i] = reg;
     }
   }
 
@@ -1438,6 +2715,35 @@ void InstBench::compile_body(x86::Assembler& a, x86::Gp reg_cnt) {
       break;
   }
 
+  if (_addr_mode != kAddrDefault)
+    emit_addr_setup(a);
+
+  // All elements are active, so masked instructions do the same work as unmasked ones.
+  if (_inst_spec.is_masked()) {
+    if (x86_features().has_avx512_bw())
+      a.kxnorq(x86::k1, x86::k1, x86::k1);
+    else
+      a.kxnorw(x86::k1, x86::k1, x86::k1);
+  }
+
+  // Load-to-use chain of MOV loads the base address from memory, the other instructions add zero to it.
+  if (_addr_chase) {
+    x86::Mem m = addr_mem(a, a.register_size(), 0, false);
+    if (inst_id == x86::Inst::kIdMov)
+      a.mov(m, a.zsi());
+    else
+      a.mov(m, 0);
+  }
+
+  // Link-only STORE chain is a pointer chase through the same memory location.
+  if (_link_only && _link_kind == kLinkStoreToLoad && !is_parallel) {
+    x86::Gp r = o1[0].as<x86::Gp>();
+    x86::Gp chase = is_64bit() ? r.r64() : r.r32();
+
+    a.lea(chase, x86::ptr(a.zsp(), misalignment));
+    a.mov(x86::ptr(chase), chase);
+  }
+
   a.test(reg_cnt, reg_cnt);
   a.jz(L_End);
 
@@ -1664,6 +2970,31 @@ void InstBench::compile_body(x86::Assembler& a, x86::Gp reg_cnt) {
     default: {
       assert(op_count <= 6);
 
+      // Special case for load-to-use chains, the loaded register is a base address of the next load.
+      if (_addr_chase) {
+        if (_overhead_only)
+          break;
+
+        x86::Mem m = addr_mem(a, a.register_size(), 0, false);
+        for (uint32_t n = 0; n < _n_unroll; n++)
+          a.emit(inst_id, a.zsi(), m);
+        break;
+      }
+
+      // Special case for instructions that don't form a dependency chain, which must be linked.
+      if (!is_parallel && _link_kind != kLinkNone) {
+        if (_overhead_only)
+          break;
+
+        Operand ops[6] = { o0[0], o1[0], o2[0], o3[0], o4[0], o5[0] };
+        for (uint32_t n = 0; n < _n_unroll; n++) {
+          if (!_link_only)
+            a.emit_op_array(inst_id, ops, op_count);
+          emit_link(a, ops);
+        }
+        break;
+      }
+
       // Special case for instructions where destination register type doesn't appear anywhere in source.
       if (!is_parallel) {
         if (op_count >= 2 && o0[0].is_reg()) {
@@ -1692,6 +3023,7 @@ void InstBench::compile_body(x86::Assembler& a, x86::Gp reg_cnt) {
             for (uint32_t n = 0; n < _n_unroll; n++) {
               if (!_overhead_only) {
                 Operand ops[6] = { o0[0], o1[0], o2[0], o3[0], o4[0], o5[0] };
+                emit_modifiers(a);
                 a.emit_op_array(inst_id, ops, op_count);
               }
 
@@ -1740,39 +3072,10 @@ void InstBench::compile_body(x86::Assembler& a, x86::Gp reg_cnt) {
       if (_overhead_only)
         break;
 
-      if (op_count == 0) {
-        for (uint32_t n = 0; n < _n_unroll; n++)
-          a.emit(inst_id);
-      }
-
-      if (op_count == 1) {
-        for (uint32_t n = 0; n < _n_unroll; n++)
-          a.emit(inst_id, o0[n]);
-      }
-
-      if (op_count == 2) {
-        for (uint32_t n = 0; n < _n_unroll; n++)
-          a.emit(inst_id, o0[n], o1[n]);
-      }
-
-      if (op_count == 3) {
-        for (uint32_t n = 0; n < _n_unroll; n++)
-          a.emit(inst_id, o0[n], o1[n], o2[n]);
-      }
-
-      if (op_count == 4) {
-        for (uint32_t n = 0; n < _n_unroll; n++)
-          a.emit(inst_id, o0[n], o1[n], o2[n], o3[n]);
-      }
-
-      if (op_count == 5) {
-        for (uint32_t n = 0; n < _n_unroll; n++)
-          a.emit(inst_id, o0[n], o1[n], o2[n], o3[n], o4[n]);
-      }
-
-      if (op_count == 6) {
-        for (uint32_t n = 0; n < _n_unroll; n++)
-          a.emit(inst_id, o0[n], o1[n], o2[n], o3[n], o4[n], o5[n]);
+      for (uint32_t n = 0; n < _n_unroll; n++) {
+        Operand ops[6] = { o0[n], o1[n], o2[n], o3[n], o4[n], o5[n] };
+        emit_modifiers(a);
+        a.emit_op_array(inst_id, ops, op_count);
       }
       break;
     }
@@ -1793,6 +3096,16 @@ void InstBench::compile_body(x86::Assembler& a, x86::Gp reg_cnt) {
     a.bind(L_RealEnd);
   }
 
+  // RIP-relative memory is embedded after the code, it's only read so it doesn't trigger self-modifying code.
+  if (_addr_mode == kAddrRip) {
+    Label L_RealEnd = a.new_label();
+    a.jmp(L_RealEnd);
+    a.align(AlignMode::kData, 64);
+    a.bind(_addr_label);
+    a.embed_uint8(0, 128);
+    a.bind(L_RealEnd);
+  }
+
   ::free(o0);
   ::free(o1);
   ::free(o2);
@@ -1809,6 +3122,89 @@ void InstBench::after_body(x86::Assembler& a) {
     a.vzeroupper();
 }
 
+void InstBench::emit_link(x86::Assembler& a, const Operand* ops) {
+  switch (_link_kind) {
+    case kLinkFlagsToGp:
+      a.adc(ops[0].as<x86::Gp>(), 0);
+      break;
+
+    case kLinkStoreToLoad: {
+      x86::Gp r = ops[1].as<x86::Gp>();
+      if (_link_only) {
+        x86::Gp chase = is_64bit() ? r.r64() : r.r32();
+        a.mov(chase, x86::ptr(chase));
+      }
+      else {
+        a.mov(r, ops[0].as<x86::Mem>());
+      }
+      break;
+    }
+  }
+}
+
+void InstBench::emit_modifiers(x86::Assembler& a) {
+  if (_inst_spec.is_lock())
+    a.lock();
+
+  if (_inst_spec.is_mask_merge())
+    a.k(x86::k1);
+  else if (_inst_spec.is_mask_zero())
+    a.k(x86::k1).z();
+
+  if (_inst_spec.is_rounding_sae())
+    a.rn_sae();
+}
+
+void InstBench::emit_addr_setup(x86::Assembler& a) {
+  x86::Gp base = a.zsi();
+  x86::Gp index = a.zdi();
+
+  switch (_addr_mode) {
+    case kAddrBase:
+    case kAddrBaseIndex:
+      a.mov(base, a.zsp());
+      break;
+
+    case kAddrBaseDisp8:
+      a.lea(base, x86::ptr(a.zsp(), -8));
+      break;
+
+    case kAddrBaseDisp32:
+    case kAddrBaseIndexDisp:
+      a.lea(base, x86::ptr(a.zsp(), -1024));
+      break;
+
+    case kAddr32:
+      a.mov(x86::esi, uint32_t(uintptr_t(_addr32_data)));
+      break;
+  }
+
+  if (_addr_mode == kAddrBaseIndex || _addr_mode == kAddrBaseIndexDisp)
+    a.xor_(index.r32(), index.r32());
+}
+
+// Returns a memory operand of the current addressing form. Parallel mode spreads the instances over 64 bytes if
+// the form has a displacement, otherwise all instances use the same address.
+x86::Mem InstBench::addr_mem(x86::Assembler& a, uint32_t size, uint32_t n, bool is_parallel) const {
+  int32_t offset = 0;
+  if (is_parallel && size < 64)
+    offset = int32_t((n % (64 / size)) * size);
+
+  x86::Gp base = a.zsi();
+  x86::Gp index = a.zdi();
+
+  switch (_addr_mode) {
+    case kAddrBase          : return x86::ptr(base, 0, size);
+    case kAddrBaseDisp8     : return x86::ptr(base, 8 + offset, size);
+    case kAddrBaseDisp32    : return x86::ptr(base, 1024 + offset, size);
+    case kAddrBaseIndex     : return x86::ptr(base, index, 0, 0, size);
+    case kAddrBaseIndexDisp : return x86::ptr(base, index, 3, 1024 + offset, size);
+    case kAddrRip           : return x86::ptr(_addr_label, offset, size);
+    case kAddr32            : return x86::ptr(x86::esi, 0, size);
+    default                 : return x86::ptr(a.zsp(), offset, size);
+  }
+}
+
 void InstBench::fill_memory_u32(x86::Assembler& a, x86::Gp base_address, uint32_t value, uint32_t n) {
   Label loop = a.new_label();
   x86::Gp cnt = x86::edi;
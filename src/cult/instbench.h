@@ -1,9 +1,11 @@
 #ifndef _CULT_INSTBENCH_H
 #define _CULT_INSTBENCH_H
 
+#include <memory>
 #include <vector>
 
 #include "basebench.h"
+#include "clockbench.h"
 
 namespace cult {
 
@@ -62,7 +64,21 @@ struct InstSpec {
   };
 
   enum Flags : uint8_t {
-    kLeaScale = 0x01
+    kLeaScale    = 0x01,
+
+    // AVX-512 modifiers.
+    kMaskMerge   = 0x02, // {k} merge-masking.
+    kMaskZero    = 0x04, // {k}{z} zero-masking.
+    kBcst16      = 0x08, // {1toN} embedded broadcast of 16-bit elements.
+    kBcst32      = 0x10, // {1toN} embedded broadcast of 32-bit elements.
+    kBcst64      = 0x20, // {1toN} embedded broadcast of 64-bit elements.
+    kRoundingSae = 0x40, // {rn-sae} embedded rounding.
+
+    kLock        = 0x80, // LOCK prefix of a memory destination.
+
+    kMaskFlags     = kMaskMerge | kMaskZero,
+    kBcstFlags     = kBcst16 | kBcst32 | kBcst64,
+    kModifierFlags = kMaskFlags | kBcstFlags | kRoundingSae
   };
 
   static inline InstSpec none() {
@@ -81,6 +97,10 @@ struct InstSpec {
     return op >= kOpVm32x && op <= kOpVm64z;
   }
 
+  static inline bool is_gp_op(uint32_t op) {
+    return op >= kOpGpb && op <= kOpRbx;
+  }
+
   inline bool operator<(const InstSpec& other) const noexcept {
     for (uint32_t i = 0; i < 6; i++)
       if (_opData[i] < other._opData[i])
@@ -100,6 +120,17 @@ struct InstSpec {
   }
 
   inline bool is_lea_scale() const noexcept { return (_flags & kLeaScale) != 0; }
+  inline bool is_mask_merge() const noexcept { return (_flags & kMaskMerge) != 0; }
+  inline bool is_mask_zero() const noexcept { return (_flags & kMaskZero) != 0; }
+  inline bool is_masked() const noexcept { return (_flags & kMaskFlags) != 0; }
+  inline bool is_rounding_sae() const noexcept { return (_flags & kRoundingSae) != 0; }
+  inline bool has_modifiers() const noexcept { return (_flags & kModifierFlags) != 0; }
+  inline bool is_lock() const noexcept { return (_flags & kLock) != 0; }
+
+  // Returns the size of a broadcasted element or zero if the memory operand is not broadcasted.
+  inline uint32_t bcst_size() const noexcept {
+    return (_flags & kBcst16) ? 2u : (_flags & kBcst32) ? 4u : (_flags & kBcst64) ? 8u : 0u;
+  }
 
   inline uint32_t count() const {
     uint32_t i = 0;
@@ -131,8 +162,12 @@ struct InstSpec {
   }
 
   inline InstSpec lea_scale() const noexcept {
+    return with_flags(kLeaScale);
+  }
+
+  inline InstSpec with_flags(uint32_t flags) const noexcept {
     InstSpec out(*this);
-    out._flags = uint8_t(out._flags | kLeaScale);
+    out._flags = uint8_t(out._flags | flags);
     return out;
   }
 
@@ -140,6 +175,49 @@ struct InstSpec {
   uint8_t _flags;
 };
 
+// ============================================================================
+// [cult::InstResult]
+// ============================================================================
+
+// Measured properties of a single instruction record.
+struct InstResult {
+  InstId inst_id;
+  InstSpec inst_spec;
+  uint32_t alignment;
+  bool show_alignment;
+
+  double lat;
+  double rcp;
+  uint32_t iter;
+  bool linked;
+  uint32_t sat_chains;
+  uint32_t units;
+
+  bool idiom;
+  bool move_candidate;
+  double idiom_lat;
+  bool dep_breaking;
+  bool zero_idiom;
+  bool move_eliminated;
+
+  // Root mean square error of the unroll fit per instruction (--unroll-fit only).
+  double fit_residual;
+
+  // Noise of `lat` and `rcp` in cycles estimated from the spread of the samples, which orders refinements of the
+  // quick pass (--time-budget only).
+  double lat_error;
+  double rcp_error;
+
+  // Core/TSC frequency ratio measured around the instruction (--track-freq only).
+  double freq_ratio;
+
+  // False if the time budget ran out before the first pass reached the result, which is then skipped.
+  bool measured;
+
+  // True if the result was measured with full precision when running with a time budget.
+  bool refined;
+};
+
 // ============================================================================
 // [cult::InstBench]
 // ============================================================================
@@ -148,11 +226,57 @@ class InstBench : public BaseBench {
 public:
   typedef void (*Func)(uint32_t nIter, uint64_t* out);
 
+  // Describes how consecutive instances of an instruction that doesn't form a dependency chain by
+  // itself are linked together when measuring latency. The latency of the link is measured separately
+  // and subtracted from the result.
+  enum LinkKind : uint32_t {
+    kLinkNone = 0,
+    kLinkFlagsToGp,  // Read-only operands producing flags, linked by `adc reg, 0`.
+    kLinkStoreToLoad // Store to memory, linked by a load of the stored register.
+  };
+
+  // Addressing forms used by `--addressing` to re-run instructions that have a memory operand. All forms
+  // address the same local memory as the default form, base and index registers are initialized before the
+  // loop (the index register is always zero).
+  enum AddrMode : uint32_t {
+    kAddrDefault = 0,   // [zsp + misalignment] used by regular tests.
+    kAddrBase,          // [base]
+    kAddrBaseDisp8,     // [base + disp8]
+    kAddrBaseDisp32,    // [base + disp32]
+    kAddrBaseIndex,     // [base + index]
+    kAddrBaseIndexDisp, // [base + index * 8 + disp32]
+    kAddrRip,           // [rip + disp32] (64-bit mode only, read-only memory embedded after the code)
+    kAddr32,            // [base32] using address-size override (64-bit mode only, memory below 4GB)
+
+    kAddrCount
+  };
+
+  // Linear fit of cycles per iteration over unroll counts.
+  struct InstFit {
+    double slope;
+    double intercept;
+    double residual;
+  };
+
   InstBench(App* app);
   virtual ~InstBench();
 
   void classify(std::vector<InstSpec>& dst, InstId inst_id);
+  void measure_inst(InstResult& result);
+  void emit_inst(const InstResult& result);
+  double refine_priority(const InstResult& result) const;
+  Func compile_instruction(InstId inst_id, InstSpec inst_spec, uint32_t parallel, uint32_t mem_alignment, bool overhead_only);
   double test_instruction(InstId inst_id, InstSpec inst_spec, uint32_t parallel, uint32_t mem_alignment, bool overhead_only);
+  InstFit fit_instruction(InstId inst_id, InstSpec inst_spec, uint32_t parallel, uint32_t mem_alignment, bool overhead_only);
+  double test_all_core(InstId inst_id, InstSpec inst_spec, const std::vector<uint32_t>& cpus, uint32_t thread_count);
+  double test_chains(InstId inst_id, InstSpec inst_spec, uint32_t mem_alignment, uint32_t n_chains);
+  double test_link(InstId inst_id, InstSpec inst_spec, uint32_t mem_alignment);
+  double test_same_reg(InstId inst_id, InstSpec inst_spec, uint32_t parallel);
+  bool same_reg_result_is_zero(InstId inst_id, InstSpec inst_spec);
+  double test_addressing(InstId inst_id, InstSpec inst_spec, uint32_t parallel, uint32_t addr_mode, bool chase);
+  bool can_use_addr_mode(InstId inst_id, InstSpec inst_spec, uint32_t addr_mode);
+  void run_addressing();
+  void run_all_core();
 
   inline bool is_64bit() const {
     return Environment::is_64bit(Arch::kHost);
@@ -160,7 +284,7 @@ public:
 
   bool is_implicit(InstId inst_id);
 
-  uint32_t num_iter_by_inst_id(InstId inst_id) const;
+  uint32_t calibrate_iter(Func func);
 
   inline bool is_mmx(InstId inst_id, InstSpec spec) {
     return spec.get(0) == InstSpec::kOpMm || spec.get(1) == InstSpec::kOpMm;
@@ -196,6 +320,9 @@ public:
   const void* ensure_gather_data(uint32_t element_size, bool is_aligned);
   void free_gather_data(uint32_t element_size);
 
+  void* ensure_addr32_data();
+  void free_addr32_data();
+
   uint32_t local_stack_size() const override;
   void run() override;
   void before_body(x86::Assembler& a) override;
@@ -203,16 +330,36 @@ public:
   void after_body(x86::Assembler& a) override;
 
   void fill_memory_u32(x86::Assembler& a, x86::Gp base_address, uint32_t value, uint32_t n);
+  void emit_link(x86::Assembler& a, const Operand* ops);
+  void emit_modifiers(x86::Assembler& a);
+  void emit_addr_setup(x86::Assembler& a);
+  x86::Mem addr_mem(x86::Assembler& a, uint32_t size, uint32_t n, bool is_parallel) const;
 
   uint32_t _inst_id {};
   InstSpec _inst_spec {};
   uint32_t _n_unroll {};
+  uint32_t _last_iter {};
+  double _last_error {};
   uint32_t _n_parallel {};
+  uint32_t _n_chains {};
+  uint32_t _max_chains {};
+  bool _fill_failed {};
   uint32_t _mem_alignment {};
   bool _overhead_only {};
+  uint32_t _link_kind {};
+  bool _link_only {};
+  bool _same_reg {};
+  uint32_t _addr_mode {};
+  bool _addr_chase {};
+  Label _addr_label {};
 
   void* _gather_data[2];
   uint32_t _gather_data_size;
+  void* _addr32_data {};
+
+  // Tracks the core/TSC frequency ratio between measurements, only created with --track-freq.
+  std::unique_ptr<ClockBench> _clock;
+  uint64_t _tsc_freq {};
 };
 
 } // {cult} namespace
@@ -0,0 +1,61 @@
+#include "memutils.h"
+
+#include <stdio.h>
+#include <string.h>
+
+namespace cult {
+
+#if defined(__linux__)
+bool MemUtils::thp_enabled() {
+  FILE* f = fopen("/sys/kernel/mm/transparent_hugepage/enabled", "rb");
+  if (!f)
+    return false;
+
+  // The active policy is in brackets, like "always [madvise] never".
+  char buf[128];
+  bool ok = fgets(buf, sizeof(buf), f) != nullptr;
+  fclose(f);
+
+  return ok && strstr(buf, "[never]") == nullptr;
+}
+
+size_t MemUtils::thp_backed_size(const void* p) {
+  FILE* f = fopen("/proc/self/smaps", "rb");
+  if (!f)
+    return 0;
+
+  char line[512];
+  bool inMapping = false;
+  size_t size = 0;
+
+  while (fgets(line, sizeof(line), f)) {
+    unsigned long long begin, end;
+    unsigned long kb;
+
+    // Each mapping starts with a header line like "7f0000000000-7f0000200000 rw-p ...", fields follow.
+    if (sscanf(line, "%llx-%llx ", &begin, &end) == 2) {
+      inMapping = uintptr_t(p) >= begin && uintptr_t(p) < end;
+      continue;
+    }
+
+    if (inMapping && sscanf(line, "AnonHugePages: %lu kB", &kb) == 1) {
+      size = size_t(kb) * 1024u;
+      break;
+    }
+  }
+
+  fclose(f);
+  return size;
+}
+#else
+bool MemUtils::thp_enabled() {
+  return false;
+}
+
+size_t MemUtils::thp_backed_size(const void* p) {
+  (void)p;
+  return 0;
+}
+#endif
+
+} // {cult} namespace
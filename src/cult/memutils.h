@@ -0,0 +1,20 @@
+#ifndef _CULT_MEMUTILS_H
+#define _CULT_MEMUTILS_H
+
+#include "globals.h"
+
+namespace cult {
+namespace MemUtils {
+
+// Returns true if transparent huge pages can be used by `madvise(MADV_HUGEPAGE)`, which requires the policy in
+// `/sys/kernel/mm/transparent_hugepage/enabled` to be "always" or "madvise" (Linux only).
+bool thp_enabled();
+
+// Returns the number of bytes of the mapping containing `p` that are backed by transparent huge pages, as reported
+// by `AnonHugePages` of `/proc/self/smaps` (Linux only, zero otherwise).
+size_t thp_backed_size(const void* p);
+
+} // MemUtils namespace
+} // {cult} namespace
+
+#endif // _CULT_MEMUTILS_H
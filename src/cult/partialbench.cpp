@@ -0,0 +1,249 @@
+#include "partialbench.h"
+
+namespace cult {
+
+struct PartialPairInfo {
+  const char* producer;
+  const char* baseline;
+  const char* consumer;
+  bool x64_only;
+};
+
+// Baselines must read the chain register like producers do, otherwise a baseline that breaks the dependency (like
+// `movzx`) would measure throughput instead of latency and the penalty would include the consumer's latency.
+static const PartialPairInfo partial_pair_info[PartialBench::kPairCount] = {
+  { "mov al, cl" , "add eax, ecx" , "add eax, edx"   , false },
+  { "add al, cl" , "add eax, ecx" , "add eax, edx"   , false },
+  { "mov ah, cl" , "add eax, ecx" , "add eax, edx"   , false },
+  { "add ah, cl" , "add eax, ecx" , "add eax, edx"   , false },
+  { "mov ax, cx" , "add eax, ecx" , "add eax, edx"   , false },
+  { "add ax, cx" , "add eax, ecx" , "add eax, edx"   , false },
+  { "add al, cl" , "add rax, rcx" , "add rax, rdx"   , true  },
+  { "add ax, cx" , "add rax, rcx" , "add rax, rdx"   , true  },
+  { "inc eax"    , "add eax, 1"   , "adc eax, edx"   , false },
+  { "dec eax"    , "sub eax, 1"   , "adc eax, edx"   , false },
+  { "inc eax"    , "add eax, 1"   , "cmovbe eax, edx", false },
+  { "shl eax, cl", "shl eax, 1"   , "adc eax, edx"   , false }
+};
+
+// ============================================================================
+// [cult::PartialBench]
+// ============================================================================
+
+PartialBench::PartialBench(App* app)
+  : BaseBench(app),
+    _pair(0),
+    _baseline(false),
+    _n_unroll(64) {}
+PartialBench::~PartialBench() {}
+
+uint32_t PartialBench::local_stack_size() const {
+  return 0;
+}
+
+void PartialBench::run() {
+  JSONBuilder& json = _app->json();
+
+  if (_app->verbose())
+    printf("Partial register and flags stalls (producer -> consumer):\n");
+
+  json.before_record()
+      .add_key("partialStalls")
+      .open_array();
+
+  for (uint32_t pair = 0; pair < kPairCount; pair++) {
+    const PartialPairInfo& info = partial_pair_info[pair];
+    if (info.x64_only && !is_64bit())
+      continue;
+
+    double cycles = test_pair(pair, false);
+    double baselineCycles = test_pair(pair, true);
+    double penalty = std::max<double>(cycles - baselineCycles, 0);
+
+    StringTmp<128> name;
+    StringTmp<128> baselineName;
+
+    name.append_format("%s -> %s", info.producer, info.consumer);
+    baselineName.append_format("%s -> %s", info.baseline, info.consumer);
+
+    if (_app->verbose())
+      printf("  %-32s: Cycles:%7.2f Baseline:%7.2f Penalty:%7.2f\n", name.data(), cycles, baselineCycles, penalty);
+
+    json.before_record()
+        .open_object()
+        .add_key("pair").add_string(name.data()).align_to(48)
+        .add_key("baseline").add_string(baselineName.data()).align_to(96)
+        .add_key("cycles").add_doublef("%7.2f", cycles)
+        .add_key("baselineCycles").add_doublef("%7.2f", baselineCycles)
+        .add_key("penalty").add_doublef("%7.2f", penalty)
+        .close_object();
+  }
+
+  if (_app->verbose())
+    printf("\n");
+
+  json.close_array(true);
+}
+
+double PartialBench::test_pair(uint32_t pair, bool baseline) {
+  _pair = pair;
+  _baseline = baseline;
+
+  Func func = compile_func();
+  if (!func) {
+    printf("FAILED to compile function for '%s -> %s' pair\n", partial_pair_info[pair].producer, partial_pair_info[pair].consumer);
+    return -1.0;
+  }
+
+  uint32_t nIter = 160;
+  uint64_t best = measure_best(func, nIter);
+
+  release_func(func);
+  return double(best) / (double(nIter * _n_unroll));
+}
+
+void PartialBench::before_body(x86::Assembler& a) {
+  (void)a;
+}
+
+void PartialBench::compile_body(x86::Assembler& a, x86::Gp reg_cnt) {
+  // EAX is the chain, ECX is used by producers, and EDX by consumers. Shifts by CL must shift by a non-zero
+  // amount, otherwise the flags would not be written at all.
+  a.xor_(x86::eax, x86::eax);
+  a.mov(x86::ecx, 1);
+  a.xor_(x86::edx, x86::edx);
+
+  Label L_Body = a.new_label();
+  Label L_End = a.new_label();
+
+  a.test(reg_cnt, reg_cnt);
+  a.jz(L_End);
+
+  a.align(AlignMode::kCode, 64);
+  a.bind(L_Body);
+
+  for (uint32_t n = 0; n < _n_unroll; n++) {
+    emit_producer(a);
+    emit_consumer(a);
+  }
+
+  a.sub(reg_cnt, 1);
+  a.jnz(L_Body);
+  a.bind(L_End);
+}
+
+void PartialBench::after_body(x86::Assembler& a) {
+  (void)a;
+}
+
+void PartialBench::emit_producer(x86::Assembler& a) {
+  switch (_pair) {
+    case kPairMovAl_AddEax:
+      if (_baseline)
+        a.add(x86::eax, x86::ecx);
+      else
+        a.mov(x86::al, x86::cl);
+      break;
+
+    case kPairAddAl_AddEax:
+      if (_baseline)
+        a.add(x86::eax, x86::ecx);
+      else
+        a.add(x86::al, x86::cl);
+      break;
+
+    case kPairMovAh_AddEax:
+      if (_baseline)
+        a.add(x86::eax, x86::ecx);
+      else
+        a.mov(x86::ah, x86::cl);
+      break;
+
+    case kPairAddAh_AddEax:
+      if (_baseline)
+        a.add(x86::eax, x86::ecx);
+      else
+        a.add(x86::ah, x86::cl);
+      break;
+
+    case kPairMovAx_AddEax:
+      if (_baseline)
+        a.add(x86::eax, x86::ecx);
+      else
+        a.mov(x86::ax, x86::cx);
+      break;
+
+    case kPairAddAx_AddEax:
+      if (_baseline)
+        a.add(x86::eax, x86::ecx);
+      else
+        a.add(x86::ax, x86::cx);
+      break;
+
+    case kPairAddAl_AddRax:
+      if (_baseline)
+        a.add(x86::rax, x86::rcx);
+      else
+        a.add(x86::al, x86::cl);
+      break;
+
+    case kPairAddAx_AddRax:
+      if (_baseline)
+        a.add(x86::rax, x86::rcx);
+      else
+        a.add(x86::ax, x86::cx);
+      break;
+
+    case kPairIncEax_AdcEax:
+    case kPairIncEax_CmovbeEax:
+      if (_baseline)
+        a.add(x86::eax, 1);
+      else
+        a.inc(x86::eax);
+      break;
+
+    case kPairDecEax_AdcEax:
+      if (_baseline)
+        a.sub(x86::eax, 1);
+      else
+        a.dec(x86::eax);
+      break;
+
+    case kPairShlEaxCl_AdcEax:
+      if (_baseline)
+        a.shl(x86::eax, 1);
+      else
+        a.shl(x86::eax, x86::cl);
+      break;
+  }
+}
+
+void PartialBench::emit_consumer(x86::Assembler& a) {
+  switch (_pair) {
+    case kPairMovAl_AddEax:
+    case kPairAddAl_AddEax:
+    case kPairMovAh_AddEax:
+    case kPairAddAh_AddEax:
+    case kPairMovAx_AddEax:
+    case kPairAddAx_AddEax:
+      a.add(x86::eax, x86::edx);
+      break;
+
+    case kPairAddAl_AddRax:
+    case kPairAddAx_AddRax:
+      a.add(x86::rax, x86::rdx);
+      break;
+
+    case kPairIncEax_AdcEax:
+    case kPairDecEax_AdcEax:
+    case kPairShlEaxCl_AdcEax:
+      a.adc(x86::eax, x86::edx);
+      break;
+
+    case kPairIncEax_CmovbeEax:
+      a.cmovbe(x86::eax, x86::edx);
+      break;
+  }
+}
+
+} // {cult} namespace
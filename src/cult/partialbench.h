@@ -0,0 +1,61 @@
+#ifndef _CULT_PARTIALBENCH_H
+#define _CULT_PARTIALBENCH_H
+
+#include "basebench.h"
+
+namespace cult {
+
+// ============================================================================
+// [cult::PartialBench]
+// ============================================================================
+
+// Measures merge penalties of partial register and partial flags writes.
+//
+// Each test is a dependency chain of producer/consumer pairs. The producer writes a part of a register (or
+// a part of flags) and the consumer reads the whole register (or flags). The penalty is the difference to
+// a baseline pair, which uses a producer that writes the whole register (or all flags) instead.
+class PartialBench : public BaseBench {
+public:
+  enum Pair : uint32_t {
+    kPairMovAl_AddEax,
+    kPairAddAl_AddEax,
+    kPairMovAh_AddEax,
+    kPairAddAh_AddEax,
+    kPairMovAx_AddEax,
+    kPairAddAx_AddEax,
+    kPairAddAl_AddRax,
+    kPairAddAx_AddRax,
+    kPairIncEax_AdcEax,
+    kPairDecEax_AdcEax,
+    kPairIncEax_CmovbeEax,
+    kPairShlEaxCl_AdcEax,
+
+    kPairCount
+  };
+
+  PartialBench(App* app);
+  virtual ~PartialBench();
+
+  inline bool is_64bit() const {
+    return Environment::is_64bit(Arch::kHost);
+  }
+
+  double test_pair(uint32_t pair, bool baseline);
+
+  void emit_producer(x86::Assembler& a);
+  void emit_consumer(x86::Assembler& a);
+
+  uint32_t local_stack_size() const override;
+  void run() override;
+  void before_body(x86::Assembler& a) override;
+  void compile_body(x86::Assembler& a, x86::Gp reg_cnt) override;
+  void after_body(x86::Assembler& a) override;
+
+  uint32_t _pair {};
+  bool _baseline {};
+  uint32_t _n_unroll {};
+};
+
+} // {cult} namespace
+
+#endif // _CULT_PARTIALBENCH_H
@@ -0,0 +1,346 @@
+#include "prefetchbench.h"
+#include "cpuutils.h"
+#include "random.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+namespace cult {
+
+static const char* prefetch_pattern_name[PrefetchBench::kPatternCount] = {
+  "chase",
+  "strided"
+};
+
+static const char* prefetch_inst_name[PrefetchBench::kPrefetchCount] = {
+  "none",
+  "prefetcht0",
+  "prefetcht1",
+  "prefetcht2",
+  "prefetchnta",
+  "prefetchw"
+};
+
+// Default prefetch distances in accesses (chase steps or strides).
+static const uint32_t prefetch_default_distances[] = { 1, 2, 4, 8, 16, 32, 64 };
+
+// Distance between accesses of the strided scan, it's large enough to touch a new line by each access.
+static constexpr uint32_t kPrefetchStride = 256;
+
+// Each test is executed multiple times and the fastest run is reported, runs continue where the previous ended.
+static constexpr uint32_t kPrefetchRuns = 32;
+
+// Builds a random cycle of `count` lines starting at line 0 and stores the order of lines into `order`.
+static void prefetch_random_cycle(std::vector<uint32_t>& order, uint32_t count, uint64_t seed) {
+  Random rg(seed);
+
+  order.resize(count);
+  for (uint32_t i = 0; i < count; i++)
+    order[i] = i;
+
+  for (uint32_t i = count - 1; i > 1; i--)
+    std::swap(order[i], order[1 + rg.next_uint32() % i]);
+}
+
+// ============================================================================
+// [cult::PrefetchBench]
+// ============================================================================
+
+PrefetchBench::PrefetchBench(App* app)
+  : BaseBench(app),
+    _pattern(0),
+    _prefetch(0),
+    _distance(0),
+    _working_set(false),
+    _n_iter(64),
+    _n_unroll(16),
+    _chase_distance(0) {
+
+  uint32_t l2 = CpuUtils::get_cache_size(2);
+  uint32_t l3 = CpuUtils::get_cache_size(3);
+
+  if (!l2) l2 = 1024u * 1024u;
+  if (!l3) l3 = 8u * 1024u * 1024u;
+
+  size_t maxSize = size_t(is_64bit() ? 256u : 64u) * 1024u * 1024u;
+  _data_size = std::min<size_t>(std::max<size_t>(size_t(l3) * 8u, 64u * 1024u * 1024u), maxSize);
+  _data = static_cast<uint8_t*>(malloc(_data_size));
+  memset(_data, 0, _data_size);
+
+  // The working set uses a half of L2 cache.
+  _ws_size = l2 / 2;
+  _ws_data = static_cast<uint8_t*>(malloc(_ws_size));
+
+  lock_data(_data, _data_size);
+  lock_data(_ws_data, _ws_size);
+
+  std::vector<uint32_t> wsOrder;
+  uint32_t wsCount = _ws_size / 64;
+
+  prefetch_random_cycle(wsOrder, wsCount, 0x5353u);
+  for (uint32_t i = 0; i < wsCount; i++) {
+    uint8_t* line = _ws_data + size_t(wsOrder[i]) * 64;
+    *reinterpret_cast<uintptr_t*>(line) = uintptr_t(_ws_data + size_t(wsOrder[(i + 1) % wsCount]) * 64);
+  }
+
+  prefetch_random_cycle(_order, uint32_t(_data_size / 64), 0x1234u);
+  build_chase(1);
+
+  _cursor[kPatternChase] = uintptr_t(_data);
+  _cursor[kPatternStrided] = uintptr_t(_data);
+}
+
+PrefetchBench::~PrefetchBench() {
+  free(_data);
+  free(_ws_data);
+}
+
+uint32_t PrefetchBench::local_stack_size() const {
+  return 0;
+}
+
+bool PrefetchBench::can_test(uint32_t prefetch) const {
+  switch (prefetch) {
+    case kPrefetchNone:
+      return true;
+
+    case kPrefetchW:
+      return x86_features().has_prefetchw();
+
+    default:
+      return x86_features().has_sse();
+  }
+}
+
+// Distances can be specified as `--prefetch-distances=4,8,...`.
+void PrefetchBench::parse_distances(std::vector<uint32_t>& dst) const {
+  const char* s = _app->cmd_line().value_of("--prefetch-distances");
+
+  if (s && *s) {
+    while (*s) {
+      char* end;
+      unsigned long d = strtoul(s, &end, 0);
+
+      if (end == s)
+        break;
+
+      if (d > 0 && d <= 1024)
+        dst.push_back(uint32_t(d));
+
+      s = *end == ',' ? end + 1 : end;
+    }
+  }
+  else {
+    for (uint32_t d : prefetch_default_distances)
+      dst.push_back(d);
+  }
+}
+
+// Each line contains a pointer to the next line and a pointer to the line `distance` steps ahead.
+void PrefetchBench::build_chase(uint32_t distance) {
+  uint32_t count = uint32_t(_order.size());
+
+  for (uint32_t i = 0; i < count; i++) {
+    uintptr_t* line = reinterpret_cast<uintptr_t*>(_data + size_t(_order[i]) * 64);
+    line[0] = uintptr_t(_data + size_t(_order[(i + 1) % count]) * 64);
+    line[1] = uintptr_t(_data + size_t(_order[(i + distance) % count]) * 64);
+  }
+
+  _chase_distance = distance;
+}
+
+void PrefetchBench::run() {
+  JSONBuilder& json = _app->json();
+
+  std::vector<uint32_t> distances;
+  parse_distances(distances);
+
+  if (distances.empty())
+    return;
+
+  // Distance of each prefetch instruction that has the best result in the strided scan, used by pollution tests.
+  uint32_t bestDistance[kPrefetchCount] {};
+
+  if (_app->verbose())
+    printf("Software prefetch (cycles per access):\n");
+
+  json.before_record()
+      .add_key("prefetch")
+      .open_array();
+
+  for (uint32_t pattern = 0; pattern < kPatternCount; pattern++) {
+    double baseline = test_prefetch(pattern, kPrefetchNone, 0, false);
+
+    for (uint32_t prefetch = kPrefetchNone + 1; prefetch < kPrefetchCount; prefetch++) {
+      if (!can_test(prefetch))
+        continue;
+
+      double best = 0.0;
+
+      for (uint32_t distance : distances) {
+        double cycles = test_prefetch(pattern, prefetch, distance, false);
+        double reduction = baseline - cycles;
+        double reductionPct = baseline > 0.0 ? reduction * 100.0 / baseline : 0.0;
+
+        if (pattern == kPatternStrided && (best == 0.0 || cycles < best)) {
+          best = cycles;
+          bestDistance[prefetch] = distance;
+        }
+
+        if (_app->verbose()) {
+          printf("  %-8s %-12s D:%-4u: Cycles:%8.2f Baseline:%8.2f Reduction:%8.2f (%5.1f%%)\n",
+            prefetch_pattern_name[pattern], prefetch_inst_name[prefetch], distance, cycles, baseline, reduction, reductionPct);
+        }
+
+        json.before_record()
+            .open_object()
+            .add_key("pattern").add_string(prefetch_pattern_name[pattern])
+            .add_key("inst").add_string(prefetch_inst_name[prefetch]).align_to(40)
+            .add_key("distance").add_uint(distance)
+            .add_key("cycles").add_doublef("%8.2f", cycles)
+            .add_key("baselineCycles").add_doublef("%8.2f", baseline)
+            .add_key("reduction").add_doublef("%8.2f", reduction)
+            .add_key("reductionPct").add_doublef("%5.1f", reductionPct)
+            .close_object();
+      }
+    }
+  }
+
+  json.close_array(true);
+
+  if (_app->verbose())
+    printf("\nSoftware prefetch pollution of an L2 resident working set (cycles per working set access):\n");
+
+  json.before_record()
+      .add_key("prefetchPollution")
+      .open_array();
+
+  double wsBaseline = test_prefetch(kPatternStrided, kPrefetchNone, 0, true) -
+                      test_prefetch(kPatternStrided, kPrefetchNone, 0, false);
+
+  for (uint32_t prefetch = kPrefetchNone + 1; prefetch < kPrefetchCount; prefetch++) {
+    if (!can_test(prefetch))
+      continue;
+
+    uint32_t distance = bestDistance[prefetch];
+    double wsCycles = test_prefetch(kPatternStrided, prefetch, distance, true) -
+                      test_prefetch(kPatternStrided, prefetch, distance, false);
+    double pollution = wsCycles - wsBaseline;
+
+    if (_app->verbose()) {
+      printf("  %-12s D:%-4u: Cycles:%8.2f Baseline:%8.2f Pollution:%8.2f\n",
+        prefetch_inst_name[prefetch], distance, wsCycles, wsBaseline, pollution);
+    }
+
+    json.before_record()
+        .open_object()
+        .add_key("inst").add_string(prefetch_inst_name[prefetch]).align_to(32)
+        .add_key("distance").add_uint(distance)
+        .add_key("wsCycles").add_doublef("%8.2f", wsCycles)
+        .add_key("wsBaselineCycles").add_doublef("%8.2f", wsBaseline)
+        .add_key("pollution").add_doublef("%8.2f", pollution)
+        .close_object();
+  }
+
+  if (_app->verbose())
+    printf("\n");
+
+  json.close_array(true);
+}
+
+double PrefetchBench::test_prefetch(uint32_t pattern, uint32_t prefetch, uint32_t distance, bool working_set) {
+  _pattern = pattern;
+  _prefetch = prefetch;
+  _distance = distance;
+  _working_set = working_set;
+
+  if (pattern == kPatternChase && prefetch != kPrefetchNone && _chase_distance != distance)
+    build_chase(distance);
+
+  Func func = compile_func();
+  if (!func) {
+    printf("FAILED to compile function for '%s' prefetch test\n", prefetch_inst_name[prefetch]);
+    return -1.0;
+  }
+
+  // The scan starts again from the beginning when the next run would go past the end of the buffer. Prefetches
+  // past the end are harmless as prefetch instructions never fault.
+  size_t scanBytes = size_t(_n_iter) * _n_unroll * kPrefetchStride;
+  uint64_t best = 0;
+
+  for (uint32_t i = 0; i < kPrefetchRuns; i++) {
+    if (pattern == kPatternStrided && _cursor[pattern] + scanBytes > uintptr_t(_data + _data_size))
+      _cursor[pattern] = uintptr_t(_data);
+
+    uint64_t n;
+    func(_n_iter, &n);
+    best = i == 0 ? n : std::min(best, n);
+  }
+
+  release_func(func);
+  return double(best) / (double(_n_iter * _n_unroll));
+}
+
+void PrefetchBench::before_body(x86::Assembler& a) {
+  a.mov(a.zax(), uintptr_t(&_cursor[_pattern]));
+  a.mov(a.zsi(), x86::ptr(a.zax()));
+  a.mov(a.zdi(), uintptr_t(_ws_data));
+  a.xor_(x86::eax, x86::eax);
+}
+
+void PrefetchBench::compile_body(x86::Assembler& a, x86::Gp reg_cnt) {
+  x86::Gp cursor = a.zsi();
+  x86::Gp ws = a.zdi();
+  x86::Gp ahead = a.zdx();
+
+  Label L_Body = a.new_label();
+  Label L_End = a.new_label();
+
+  a.test(reg_cnt, reg_cnt);
+  a.jz(L_End);
+
+  a.align(AlignMode::kCode, 64);
+  a.bind(L_Body);
+
+  for (uint32_t n = 0; n < _n_unroll; n++) {
+    if (_pattern == kPatternChase) {
+      if (_prefetch != kPrefetchNone) {
+        a.mov(ahead, x86::ptr(cursor, int32_t(a.register_size())));
+        emit_prefetch(a, x86::byte_ptr(ahead));
+      }
+      a.mov(cursor, x86::ptr(cursor));
+    }
+    else {
+      if (_prefetch != kPrefetchNone)
+        emit_prefetch(a, x86::byte_ptr(cursor, int32_t((n + _distance) * kPrefetchStride)));
+      a.add(x86::eax, x86::dword_ptr(cursor, int32_t(n * kPrefetchStride)));
+    }
+
+    if (_working_set)
+      a.mov(ws, x86::ptr(ws));
+  }
+
+  if (_pattern == kPatternStrided)
+    a.add(cursor, int32_t(_n_unroll * kPrefetchStride));
+
+  a.sub(reg_cnt, 1);
+  a.jnz(L_Body);
+  a.bind(L_End);
+}
+
+void PrefetchBench::after_body(x86::Assembler& a) {
+  a.mov(a.zax(), uintptr_t(&_cursor[_pattern]));
+  a.mov(x86::ptr(a.zax()), a.zsi());
+}
+
+void PrefetchBench::emit_prefetch(x86::Assembler& a, const x86::Mem& m) {
+  switch (_prefetch) {
+    case kPrefetchT0 : a.prefetcht0(m); break;
+    case kPrefetchT1 : a.prefetcht1(m); break;
+    case kPrefetchT2 : a.prefetcht2(m); break;
+    case kPrefetchNta: a.prefetchnta(m); break;
+    case kPrefetchW  : a.prefetchw(m); break;
+  }
+}
+
+} // {cult} namespace
@@ -0,0 +1,85 @@
+#ifndef _CULT_PREFETCHBENCH_H
+#define _CULT_PREFETCHBENCH_H
+
+#include <vector>
+
+#include "basebench.h"
+
+namespace cult {
+
+// ============================================================================
+// [cult::PrefetchBench]
+// ============================================================================
+
+// Measures how much software prefetches reduce the cost of accesses that miss the cache.
+//
+// Two access patterns are used: a pointer chase over a random cycle of cache lines, where each line also contains
+// a pointer to the line N steps ahead (the prefetch target), and a strided scan, which prefetches the address N
+// strides ahead. Both patterns are much larger than the last level cache and continue where the previous run
+// stopped, so accesses miss the cache even when a test runs many times.
+//
+// Pollution is measured by walking an L2 resident working set between accesses of the strided scan. The extra
+// time spent in the working set with a prefetch, compared to the same scan without it, shows how much the
+// prefetched lines evict the working set.
+class PrefetchBench : public BaseBench {
+public:
+  enum Pattern : uint32_t {
+    kPatternChase,
+    kPatternStrided,
+
+    kPatternCount
+  };
+
+  enum Prefetch : uint32_t {
+    kPrefetchNone,
+    kPrefetchT0,
+    kPrefetchT1,
+    kPrefetchT2,
+    kPrefetchNta,
+    kPrefetchW,
+
+    kPrefetchCount
+  };
+
+  PrefetchBench(App* app);
+  virtual ~PrefetchBench();
+
+  inline bool is_64bit() const {
+    return Environment::is_64bit(Arch::kHost);
+  }
+
+  bool can_test(uint32_t prefetch) const;
+  void parse_distances(std::vector<uint32_t>& dst) const;
+  void build_chase(uint32_t distance);
+  double test_prefetch(uint32_t pattern, uint32_t prefetch, uint32_t distance, bool working_set);
+
+  uint32_t local_stack_size() const override;
+  void run() override;
+  void before_body(x86::Assembler& a) override;
+  void compile_body(x86::Assembler& a, x86::Gp reg_cnt) override;
+  void after_body(x86::Assembler& a) override;
+
+  void emit_prefetch(x86::Assembler& a, const x86::Mem& m);
+
+  uint32_t _pattern {};
+  uint32_t _prefetch {};
+  uint32_t _distance {};
+  bool _working_set {};
+  uint32_t _n_iter {};
+  uint32_t _n_unroll {};
+
+  // Chase and scan positions, they are loaded at the beginning of each run and stored at its end.
+  uintptr_t _cursor[kPatternCount] {};
+  uint32_t _chase_distance {};
+
+  size_t _data_size {};
+  uint8_t* _data {};
+  std::vector<uint32_t> _order;
+
+  uint32_t _ws_size {};
+  uint8_t* _ws_data {};
+};
+
+} // {cult} namespace
+
+#endif // _CULT_PREFETCHBENCH_H
@@ -5,29 +5,219 @@
 #include <mach/thread_policy.h>
 #endif
 
+#if defined(__linux__)
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <sys/mman.h>
+#endif
+
+#include <algorithm>
+#include <thread>
+
 namespace cult {
 
 #if defined(_WIN32)
-void SchedUtils::set_affinity(uint32_t cpu) {
-  SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)(uint64_t(1) << cpu));
+bool SchedUtils::set_affinity(uint32_t cpu) {
+  return SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)(uint64_t(1) << cpu)) != 0;
 }
 #elif defined(__APPLE__)
-void SchedUtils::set_affinity(uint32_t cpu) {
+bool SchedUtils::set_affinity(uint32_t cpu) {
   pthread_t thread = pthread_self();
   thread_port_t mach_thread = pthread_mach_thread_np(thread);
   thread_affinity_policy_data_t policy = { int(cpu) };
 
-  thread_policy_set(mach_thread, THREAD_AFFINITY_POLICY, (thread_policy_t)&policy, 1);
+  // Affinity is only a hint on macOS, the thread may still run on any CPU.
+  return thread_policy_set(mach_thread, THREAD_AFFINITY_POLICY, (thread_policy_t)&policy, 1) == KERN_SUCCESS;
 }
 #else
-void SchedUtils::set_affinity(uint32_t cpu) {
+bool SchedUtils::set_affinity(uint32_t cpu) {
   pthread_t thread = pthread_self();
   cpu_set_t cpus;
 
   CPU_ZERO(&cpus);
   CPU_SET(cpu, &cpus);
 
-  pthread_setaffinity_np(thread, sizeof(cpus), &cpus);
+  return pthread_setaffinity_np(thread, sizeof(cpus), &cpus) == 0;
+}
+#endif
+
+uint32_t SchedUtils::cpu_count() {
+  uint32_t n = std::thread::hardware_concurrency();
+  return n ? n : 1u;
+}
+
+#if defined(_WIN32)
+static std::vector<uint32_t> query_allowed_cpus() {
+  std::vector<uint32_t> cpus;
+  DWORD_PTR processMask;
+  DWORD_PTR systemMask;
+
+  if (GetProcessAffinityMask(GetCurrentProcess(), &processMask, &systemMask)) {
+    for (uint32_t cpu = 0; cpu < sizeof(DWORD_PTR) * 8; cpu++)
+      if ((uint64_t(processMask) >> cpu) & 1u)
+        cpus.push_back(cpu);
+  }
+
+  if (cpus.empty())
+    cpus.push_back(0);
+  return cpus;
+}
+#elif defined(__linux__)
+// Returns true if `cpu` is the first thread of its physical core (or if the topology is not available).
+static bool is_first_core_thread(uint32_t cpu) {
+  char path[128];
+  snprintf(path, sizeof(path), "/sys/devices/system/cpu/cpu%u/topology/thread_siblings_list", cpu);
+
+  FILE* f = fopen(path, "rb");
+  if (!f)
+    return true;
+
+  unsigned first;
+  bool ok = fscanf(f, "%u", &first) == 1;
+  fclose(f);
+
+  return !ok || first == cpu;
+}
+
+static std::vector<uint32_t> query_allowed_cpus() {
+  std::vector<uint32_t> cpus;
+  std::vector<uint32_t> siblings;
+  cpu_set_t mask;
+
+  CPU_ZERO(&mask);
+  if (sched_getaffinity(0, sizeof(mask), &mask) == 0) {
+    for (uint32_t cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+      if (!CPU_ISSET(cpu, &mask))
+        continue;
+
+      if (is_first_core_thread(cpu))
+        cpus.push_back(cpu);
+      else
+        siblings.push_back(cpu);
+    }
+  }
+
+  cpus.insert(cpus.end(), siblings.begin(), siblings.end());
+
+  if (cpus.empty())
+    cpus.push_back(0);
+  return cpus;
+}
+#else
+static std::vector<uint32_t> query_allowed_cpus() {
+  std::vector<uint32_t> cpus;
+  uint32_t n = SchedUtils::cpu_count();
+
+  for (uint32_t cpu = 0; cpu < n; cpu++)
+    cpus.push_back(cpu);
+  return cpus;
+}
+#endif
+
+// CPU of the measuring thread after `isolate()`, which is not used by threads of multi-threaded benchmarks.
+static uint32_t isolated_cpu = 0xFFFFFFFFu;
+
+std::vector<uint32_t> SchedUtils::allowed_cpus() {
+  std::vector<uint32_t> cpus = query_allowed_cpus();
+
+  if (cpus.size() > 1u)
+    cpus.erase(std::remove(cpus.begin(), cpus.end(), isolated_cpu), cpus.end());
+
+  return cpus;
+}
+
+#if defined(__linux__)
+// Size of the stack prefaulted by `isolate()`, which is much more than any benchmark uses.
+static constexpr size_t kPrefaultStackSize = 256 * 1024;
+
+// Touches stack pages below the caller so they are mapped before `mlockall()` locks them.
+static void prefault_stack() {
+  volatile uint8_t stack[kPrefaultStackSize];
+  for (size_t i = 0; i < kPrefaultStackSize; i += 4096)
+    stack[i] = 0;
+  (void)stack;
+}
+
+// Returns true if `cpu` is in a CPU list file like `/sys/devices/system/cpu/isolated` (format "0-3,8,10-11").
+static bool cpu_list_contains(const char* path, uint32_t cpu) {
+  FILE* f = fopen(path, "rb");
+  if (!f)
+    return false;
+
+  char buf[1024];
+  bool ok = fgets(buf, sizeof(buf), f) != nullptr;
+  fclose(f);
+
+  if (!ok)
+    return false;
+
+  const char* p = buf;
+  while (*p >= '0' && *p <= '9') {
+    char* end;
+    unsigned long first = strtoul(p, &end, 10);
+    unsigned long last = first;
+
+    if (*end == '-')
+      last = strtoul(end + 1, &end, 10);
+
+    if (cpu >= first && cpu <= last)
+      return true;
+
+    p = *end == ',' ? end + 1 : end;
+  }
+
+  return false;
+}
+
+void SchedUtils::isolate(uint32_t cpu, IsolationInfo& info) {
+  info = IsolationInfo {};
+  info.cpu = cpu;
+
+  // SCHED_FIFO preempts all normal tasks on the CPU, including kernel work deferred to normal priority threads
+  // (like kworkers), which only run when the measuring thread blocks or when RT throttling kicks in (by default
+  // after 950ms of every second). Threads created later by multi-threaded benchmarks don't inherit it, so they
+  // cannot starve the thread that started them.
+  struct sched_param param {};
+  param.sched_priority = sched_get_priority_min(SCHED_FIFO);
+  info.realtime = sched_setscheduler(0, SCHED_FIFO | SCHED_RESET_ON_FORK, &param) == 0;
+
+  // MCL_FUTURE is not used as it would populate all future mappings, which would make page fault and huge page
+  // benchmarks meaningless. JIT code and data buffers of benchmarks are locked by `lock_memory()` instead.
+  prefault_stack();
+  info.memory_locked = mlockall(MCL_CURRENT) == 0;
+
+  // No other thread exists yet, threads created later by benchmarks are pinned to other CPUs, see `allowed_cpus()`.
+  isolated_cpu = cpu;
+
+  info.isolated = cpu_list_contains("/sys/devices/system/cpu/isolated", cpu);
+  info.nohz_full = cpu_list_contains("/sys/devices/system/cpu/nohz_full", cpu);
+}
+
+// Populates the range even if it cannot be locked (RLIMIT_MEMLOCK), so at least the first access doesn't fault.
+bool SchedUtils::lock_memory(const void* p, size_t size) {
+  if (mlock(p, size) == 0)
+    return true;
+
+#if defined(MADV_POPULATE_WRITE)
+  uintptr_t begin = uintptr_t(p) & ~uintptr_t(4095u);
+  uintptr_t end = uintptr_t(p) + size;
+  madvise(reinterpret_cast<void*>(begin), end - begin, MADV_POPULATE_WRITE);
+#endif
+
+  return false;
+}
+#else
+void SchedUtils::isolate(uint32_t cpu, IsolationInfo& info) {
+  info = IsolationInfo {};
+  info.cpu = cpu;
+  isolated_cpu = cpu;
+}
+
+bool SchedUtils::lock_memory(const void* p, size_t size) {
+  (void)p;
+  (void)size;
+  return false;
 }
 #endif
 
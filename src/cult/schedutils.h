@@ -3,10 +3,41 @@
 
 #include "globals.h"
 
+#include <vector>
+
 namespace cult {
 namespace SchedUtils {
 
-void set_affinity(uint32_t cpu);
+// Result of `isolate()`, each member is false (or zero) if the step failed or is not supported.
+struct IsolationInfo {
+  uint32_t cpu;
+  bool realtime;
+  bool memory_locked;
+  bool isolated;
+  bool nohz_full;
+};
+
+// Pins the calling thread to `cpu`, returns false if the CPU is not available to the process.
+bool set_affinity(uint32_t cpu);
+
+// Returns the number of logical CPUs (at least one).
+uint32_t cpu_count();
+
+// Returns CPUs the process is allowed to run on (respecting `taskset` and cpusets), which is what threads of
+// multi-threaded benchmarks are pinned to. The first thread of each physical core comes first and SMT siblings
+// follow, so a thread count not greater than the number of cores never puts two threads on the same core. The CPU
+// isolated by `isolate()` is excluded unless it's the only one.
+std::vector<uint32_t> allowed_cpus();
+
+// Isolates the calling thread, which must already be pinned to `cpu` (Linux only).
+//
+// Raises the thread to SCHED_FIFO (if permitted), prefaults and locks the pages mapped so far, reserves `cpu` so
+// threads created later are pinned to other CPUs, and checks whether `cpu` is listed in `isolcpus` and `nohz_full`.
+void isolate(uint32_t cpu, IsolationInfo& info);
+
+// Prefaults and locks a range of memory allocated after `isolate()`, returns false if it was only prefaulted or
+// not at all (Linux only).
+bool lock_memory(const void* p, size_t size);
 
 } // SchedUtils namespace
 } // {cult} namespace
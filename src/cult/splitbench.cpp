@@ -0,0 +1,263 @@
+#include "splitbench.h"
+
+#include <stdlib.h>
+
+namespace cult {
+
+// Offsets relative to a line (or the last line of a page), accesses of `width` bytes split if `offset + width > 64`.
+static const uint8_t split_offsets[] = { 0, 1, 4, 8, 16, 24, 32, 40, 48, 56, 60, 62, 63 };
+
+static const uint32_t split_widths[] = { 4, 8, 16, 32, 64 };
+
+// Registers used by GP accesses, EBP is the loop counter and ESI holds the address.
+static const uint32_t split_gp_ids[] = {
+  x86::Gp::kIdAx, x86::Gp::kIdCx, x86::Gp::kIdDx, x86::Gp::kIdBx, x86::Gp::kIdDi
+};
+
+static const char* split_kind_name(uint32_t kind) {
+  switch (kind) {
+    case SplitBench::kKindLoad  : return "load";
+    case SplitBench::kKindStore : return "store";
+    case SplitBench::kKindLoadOp: return "load-op";
+    case SplitBench::kKindRMW   : return "rmw";
+    default                     : return "unknown";
+  }
+}
+
+static void split_inst_name(String& sb, uint32_t kind, uint32_t width, bool vex) {
+  if (width <= 8) {
+    const char* r = width == 4 ? "r32" : "r64";
+    switch (kind) {
+      case SplitBench::kKindLoad  : sb.append_format("mov %s, [m]", r); break;
+      case SplitBench::kKindStore : sb.append_format("mov [m], %s", r); break;
+      case SplitBench::kKindLoadOp: sb.append_format("add %s, [m]", r); break;
+      case SplitBench::kKindRMW   : sb.append_format("add [m], %s", r); break;
+    }
+  }
+  else {
+    const char* v = width == 16 ? "xmm" : width == 32 ? "ymm" : "zmm";
+    const char* mov = width == 64 ? "vmovdqu32" : vex ? "vmovdqu" : "movdqu";
+
+    switch (kind) {
+      case SplitBench::kKindLoad  : sb.append_format("%s %s, [m]", mov, v); break;
+      case SplitBench::kKindStore : sb.append_format("%s [m], %s", mov, v); break;
+      case SplitBench::kKindLoadOp: sb.append_format("vpaddd %s, %s, [m]", v, v); break;
+    }
+  }
+}
+
+// ============================================================================
+// [cult::SplitBench]
+// ============================================================================
+
+SplitBench::SplitBench(App* app)
+  : BaseBench(app),
+    _kind(0),
+    _width(0),
+    _boundary(0),
+    _offset(0),
+    _n_unroll(64) {
+
+  // Three pages aligned to a page boundary, the page boundary is crossed between the second and the third page.
+  _data = calloc(1, 4096 * 4);
+  lock_data(_data, 4096 * 4);
+  _aligned_data = reinterpret_cast<uint8_t*>((uintptr_t(_data) + 4095u) & ~uintptr_t(4095u));
+}
+
+SplitBench::~SplitBench() {
+  free(_data);
+}
+
+uint32_t SplitBench::local_stack_size() const {
+  return 0;
+}
+
+bool SplitBench::can_test(uint32_t kind, uint32_t width) const {
+  switch (width) {
+    case 4:
+      return true;
+
+    case 8:
+      return is_64bit();
+
+    case 16:
+      // Legacy SSE load-op requires aligned memory.
+      return kind == kKindLoad || kind == kKindStore || (kind == kKindLoadOp && x86_features().has_avx());
+
+    case 32:
+      return kind == kKindLoad || kind == kKindStore ? x86_features().has_avx()
+                                                     : kind == kKindLoadOp && x86_features().has_avx2();
+
+    case 64:
+      return kind != kKindRMW && x86_features().has_avx512_f();
+
+    default:
+      return false;
+  }
+}
+
+void SplitBench::run() {
+  JSONBuilder& json = _app->json();
+
+  if (_app->verbose())
+    printf("Cache line and page split penalties (cycles per access):\n");
+
+  json.before_record()
+      .add_key("splitPenalties")
+      .open_array();
+
+  for (uint32_t kind = 0; kind < kKindCount; kind++) {
+    for (uint32_t width : split_widths) {
+      if (!can_test(kind, width))
+        continue;
+
+      double aligned = test_access(kind, width, kBoundaryLine, 0);
+      double misaligned = aligned;
+      double lineSplit = 0.0;
+      double pageSplit = 0.0;
+
+      for (uint32_t offset : split_offsets) {
+        if (offset == 0)
+          continue;
+
+        if (offset + width <= 64) {
+          misaligned = std::max(misaligned, test_access(kind, width, kBoundaryLine, offset));
+        }
+        else {
+          lineSplit = std::max(lineSplit, test_access(kind, width, kBoundaryLine, offset));
+          pageSplit = std::max(pageSplit, test_access(kind, width, kBoundaryPage, offset));
+        }
+      }
+
+      double linePenalty = std::max<double>(lineSplit - aligned, 0);
+      double pagePenalty = std::max<double>(pageSplit - aligned, 0);
+
+      StringTmp<64> name;
+      split_inst_name(name, kind, width, x86_features().has_avx());
+
+      if (_app->verbose()) {
+        printf("  %-24s: Aligned:%7.2f Misaligned:%7.2f LineSplit:%7.2f PageSplit:%7.2f\n",
+          name.data(), aligned, misaligned, lineSplit, pageSplit);
+      }
+
+      json.before_record()
+          .open_object()
+          .add_key("inst").add_string(name.data()).align_to(40)
+          .add_key("kind").add_string(split_kind_name(kind))
+          .add_key("width").add_uint(width)
+          .add_key("aligned").add_doublef("%7.2f", aligned)
+          .add_key("misaligned").add_doublef("%7.2f", misaligned)
+          .add_key("lineSplit").add_doublef("%7.2f", lineSplit)
+          .add_key("pageSplit").add_doublef("%7.2f", pageSplit)
+          .add_key("linePenalty").add_doublef("%7.2f", linePenalty)
+          .add_key("pagePenalty").add_doublef("%7.2f", pagePenalty)
+          .close_object();
+    }
+  }
+
+  if (_app->verbose())
+    printf("\n");
+
+  json.close_array(true);
+}
+
+double SplitBench::test_access(uint32_t kind, uint32_t width, uint32_t boundary, uint32_t offset) {
+  _kind = kind;
+  _width = width;
+  _boundary = boundary;
+  _offset = offset;
+
+  Func func = compile_func();
+  if (!func) {
+    printf("FAILED to compile function for '%s' split test\n", split_kind_name(kind));
+    return -1.0;
+  }
+
+  uint32_t nIter = 160;
+  uint64_t best = measure_best(func, nIter);
+
+  release_func(func);
+  return double(best) / (double(nIter * _n_unroll));
+}
+
+void SplitBench::before_body(x86::Assembler& a) {
+  if (_width >= 16) {
+    for (uint32_t i = 0; i < 8; i++) {
+      if (x86_features().has_avx())
+        a.vpxor(x86::xmm(i), x86::xmm(i), x86::xmm(i));
+      else
+        a.pxor(x86::xmm(i), x86::xmm(i));
+    }
+  }
+}
+
+void SplitBench::compile_body(x86::Assembler& a, x86::Gp reg_cnt) {
+  // Line tests use the second line of the middle page, page tests use the last line of the middle page.
+  uint8_t* address = _boundary == kBoundaryLine ? _aligned_data + 4096 + 64 : _aligned_data + 8192 - 64;
+  x86::Mem mem = x86::ptr(a.zsi(), int32_t(_offset), _width);
+
+  a.mov(a.zsi(), uintptr_t(address));
+  for (uint32_t id : split_gp_ids)
+    a.xor_(x86::gpd(id), x86::gpd(id));
+
+  Label L_Body = a.new_label();
+  Label L_End = a.new_label();
+
+  a.test(reg_cnt, reg_cnt);
+  a.jz(L_End);
+
+  a.align(AlignMode::kCode, 64);
+  a.bind(L_Body);
+
+  for (uint32_t n = 0; n < _n_unroll; n++)
+    emit_access(a, mem, n);
+
+  a.sub(reg_cnt, 1);
+  a.jnz(L_Body);
+  a.bind(L_End);
+}
+
+void SplitBench::after_body(x86::Assembler& a) {
+  if (_width >= 16 && x86_features().has_avx())
+    a.vzeroupper();
+}
+
+void SplitBench::emit_access(x86::Assembler& a, const x86::Mem& mem, uint32_t n) {
+  if (_width <= 8) {
+    uint32_t id = split_gp_ids[n % ASMJIT_ARRAY_SIZE(split_gp_ids)];
+    x86::Gp r = _width == 4 ? x86::gpd(id) : x86::gpq(id);
+
+    switch (_kind) {
+      case kKindLoad  : a.mov(r, mem); break;
+      case kKindStore : a.mov(mem, r); break;
+      case kKindLoadOp: a.add(r, mem); break;
+      case kKindRMW   : a.add(mem, r); break;
+    }
+    return;
+  }
+
+  x86::Vec v = _width == 16 ? x86::xmm(n % 8) : _width == 32 ? x86::ymm(n % 8) : x86::zmm(n % 8);
+
+  if (_width == 64) {
+    switch (_kind) {
+      case kKindLoad  : a.vmovdqu32(v, mem); break;
+      case kKindStore : a.vmovdqu32(mem, v); break;
+      case kKindLoadOp: a.vpaddd(v, v, mem); break;
+    }
+  }
+  else if (x86_features().has_avx()) {
+    switch (_kind) {
+      case kKindLoad  : a.vmovdqu(v, mem); break;
+      case kKindStore : a.vmovdqu(mem, v); break;
+      case kKindLoadOp: a.vpaddd(v, v, mem); break;
+    }
+  }
+  else {
+    switch (_kind) {
+      case kKindLoad  : a.movdqu(v, mem); break;
+      case kKindStore : a.movdqu(mem, v); break;
+    }
+  }
+}
+
+} // {cult} namespace
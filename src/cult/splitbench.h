@@ -0,0 +1,64 @@
+#ifndef _CULT_SPLITBENCH_H
+#define _CULT_SPLITBENCH_H
+
+#include "basebench.h"
+
+namespace cult {
+
+// ============================================================================
+// [cult::SplitBench]
+// ============================================================================
+
+// Measures penalties of memory accesses that cross a cache line (64 bytes) or a page (4KB) boundary.
+//
+// Each test is a stream of accesses to the same address, which is moved over a range of offsets relative to a line
+// boundary and to a page boundary. Loads, stores, and load-op accesses are independent, but each RMW access loads
+// the value stored by the previous one, so RMW tests measure a store forwarding chain. The penalty is the difference
+// between the worst split access and the aligned access of the same kind and width.
+class SplitBench : public BaseBench {
+public:
+  enum Kind : uint32_t {
+    kKindLoad,
+    kKindStore,
+    kKindLoadOp,
+    kKindRMW,
+
+    kKindCount
+  };
+
+  enum Boundary : uint32_t {
+    kBoundaryLine,
+    kBoundaryPage
+  };
+
+  SplitBench(App* app);
+  virtual ~SplitBench();
+
+  inline bool is_64bit() const {
+    return Environment::is_64bit(Arch::kHost);
+  }
+
+  bool can_test(uint32_t kind, uint32_t width) const;
+  double test_access(uint32_t kind, uint32_t width, uint32_t boundary, uint32_t offset);
+
+  void emit_access(x86::Assembler& a, const x86::Mem& mem, uint32_t n);
+
+  uint32_t local_stack_size() const override;
+  void run() override;
+  void before_body(x86::Assembler& a) override;
+  void compile_body(x86::Assembler& a, x86::Gp reg_cnt) override;
+  void after_body(x86::Assembler& a) override;
+
+  uint32_t _kind {};
+  uint32_t _width {};
+  uint32_t _boundary {};
+  uint32_t _offset {};
+  uint32_t _n_unroll {};
+
+  void* _data {};
+  uint8_t* _aligned_data {};
+};
+
+} // {cult} namespace
+
+#endif // _CULT_SPLITBENCH_H
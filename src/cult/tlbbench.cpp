@@ -0,0 +1,372 @@
+#include "memutils.h"
+#include "random.h"
+#include "tlbbench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#if defined(__linux__)
+#include <sys/mman.h>
+#endif
+
+namespace cult {
+
+static const char* tlb_backing_name[TlbBench::kBackingCount] = {
+  "4k",
+  "thp",
+  "hugetlb"
+};
+
+// Size of a slot that contains a single node of the chase.
+static constexpr uint32_t kTlbSlotSize = 4096;
+
+// The smallest footprint of the sweep.
+static constexpr size_t kTlbMinFootprint = 16u * 1024u;
+
+// Each footprint is executed multiple times and the fastest run is reported, runs continue where the previous ended.
+static constexpr uint32_t kTlbRuns = 20;
+
+// Increase of the TLB cost (in cycles) that is considered a miss of the first level TLB and a miss of the second
+// level TLB.
+static constexpr double kTlbDtlbKnee = 3.0;
+static constexpr double kTlbStlbKnee = 10.0;
+
+// Returns the default size of explicit huge pages or zero if unknown.
+static size_t tlb_hugetlb_page_size() {
+#if defined(__linux__)
+  FILE* f = fopen("/proc/meminfo", "rb");
+  if (!f)
+    return 0;
+
+  char line[256];
+  size_t size = 0;
+
+  while (fgets(line, sizeof(line), f)) {
+    unsigned long kb;
+    if (sscanf(line, "Hugepagesize: %lu kB", &kb) == 1) {
+      size = size_t(kb) * 1024u;
+      break;
+    }
+  }
+
+  fclose(f);
+  return size;
+#else
+  return 0;
+#endif
+}
+
+// Returns the index of the last footprint, which latency doesn't exceed the latency at `from` by more than `knee`.
+static size_t tlb_knee(const std::vector<double>& cycles, size_t from, double knee) {
+  size_t i = from;
+  while (i + 1 < cycles.size() && cycles[i + 1] <= cycles[from] + knee)
+    i++;
+  return i;
+}
+
+// ============================================================================
+// [cult::TlbBench]
+// ============================================================================
+
+TlbBench::TlbBench(App* app)
+  : BaseBench(app),
+    _n_iter(64),
+    _n_unroll(64) {
+
+  _max_footprint = size_t(is_64bit() ? 256u : 64u) * 1024u * 1024u;
+}
+
+TlbBench::~TlbBench() {}
+
+uint32_t TlbBench::local_stack_size() const {
+  return 0;
+}
+
+// Allocates memory backed by the requested pages, the memory is touched, so all pages are present.
+bool TlbBench::alloc_backing(Block& block, uint32_t backing, size_t size) {
+  block = Block {};
+
+#if defined(__linux__)
+  constexpr size_t kThpSize = 2u * 1024u * 1024u;
+
+  switch (backing) {
+    case kBacking4K:
+    case kBackingThp: {
+      size_t mapSize = size + kThpSize;
+      void* p = mmap(nullptr, mapSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+      if (p == MAP_FAILED)
+        return false;
+
+      uint8_t* data = reinterpret_cast<uint8_t*>((uintptr_t(p) + kThpSize - 1u) & ~uintptr_t(kThpSize - 1u));
+      madvise(data, size, backing == kBackingThp ? MADV_HUGEPAGE : MADV_NOHUGEPAGE);
+
+      block = Block { p, mapSize, data, size, true };
+      break;
+    }
+
+    case kBackingHugeTlb: {
+#if defined(MAP_HUGETLB)
+      size_t pageSize = tlb_hugetlb_page_size();
+      if (!pageSize)
+        return false;
+
+      size_t mapSize = (size + pageSize - 1u) & ~(pageSize - 1u);
+      void* p = mmap(nullptr, mapSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_HUGETLB, -1, 0);
+      if (p == MAP_FAILED)
+        return false;
+
+      block = Block { p, mapSize, static_cast<uint8_t*>(p), size, true };
+      break;
+#else
+      return false;
+#endif
+    }
+
+    default:
+      return false;
+  }
+#else
+  // Huge pages are only supported on Linux.
+  if (backing != kBacking4K)
+    return false;
+
+  void* p = malloc(size + kTlbSlotSize);
+  if (!p)
+    return false;
+
+  uint8_t* data = reinterpret_cast<uint8_t*>((uintptr_t(p) + kTlbSlotSize - 1u) & ~uintptr_t(kTlbSlotSize - 1u));
+  block = Block { p, size + kTlbSlotSize, data, size, false };
+#endif
+
+  memset(block.data, 0, block.data_size);
+
+  // The kernel doesn't have to honor MADV_HUGEPAGE, the backing is only used if most of it are huge pages.
+  if (backing == kBackingThp && MemUtils::thp_backed_size(block.data) < size / 2u) {
+    free_backing(block);
+    return false;
+  }
+
+  return true;
+}
+
+void TlbBench::free_backing(Block& block) {
+#if defined(__linux__)
+  if (block.mapped)
+    munmap(block.ptr, block.size);
+  else
+    free(block.ptr);
+#else
+  free(block.ptr);
+#endif
+
+  block = Block {};
+}
+
+// Links one node in each slot of the footprint into a random cycle starting at the first slot.
+void TlbBench::build_chase(uint8_t* data, size_t footprint) {
+  uint32_t count = uint32_t(footprint / kTlbSlotSize);
+  Random rg(0x7777u + count);
+
+  _order.resize(count);
+  for (uint32_t i = 0; i < count; i++)
+    _order[i] = i;
+
+  for (uint32_t i = count - 1; i > 1; i--)
+    std::swap(_order[i], _order[1 + rg.next_uint32() % i]);
+
+  auto node = [&](uint32_t slot) -> uint8_t* {
+    return data + size_t(slot) * kTlbSlotSize + (slot % (kTlbSlotSize / 64)) * 64u;
+  };
+
+  for (uint32_t i = 0; i < count; i++)
+    *reinterpret_cast<uintptr_t*>(node(_order[i])) = uintptr_t(node(_order[(i + 1) % count]));
+
+  _cursor = uintptr_t(node(_order[0]));
+}
+
+void TlbBench::run() {
+  JSONBuilder& json = _app->json();
+
+  struct Reach {
+    uint32_t backing;
+    uint32_t control;
+    size_t page_size;
+    size_t dtlb_reach;
+    size_t stlb_reach;
+    double walk_cycles;
+  };
+
+  std::vector<Reach> reaches;
+
+  if (_app->verbose())
+    printf("TLB reach (cycles per dependent load, one load per 4KB slot):\n");
+
+  json.before_record()
+      .add_key("tlbChase")
+      .open_array();
+
+  // Cycles of each footprint of each backing, empty if the backing is not available.
+  std::vector<size_t> footprints;
+  std::vector<double> backingCycles[kBackingCount];
+
+  for (uint32_t backing = 0; backing < kBackingCount; backing++) {
+    Block block;
+    size_t maxFootprint = _max_footprint;
+
+    if (backing == kBackingThp && !MemUtils::thp_enabled()) {
+      if (_app->verbose())
+        printf("  %-8s: Not available\n", tlb_backing_name[backing]);
+      continue;
+    }
+
+    // Explicit huge pages must be reserved by the system, smaller footprints are tried if there is not enough.
+    while (!alloc_backing(block, backing, maxFootprint)) {
+      maxFootprint /= 2;
+      if (backing != kBackingHugeTlb || maxFootprint < 4u * 1024u * 1024u)
+        break;
+    }
+
+    if (!block.data) {
+      if (_app->verbose())
+        printf("  %-8s: Not available\n", tlb_backing_name[backing]);
+      continue;
+    }
+
+    size_t pageSize = backing == kBacking4K ? size_t(4096) :
+                      backing == kBackingThp ? size_t(2u * 1024u * 1024u) : tlb_hugetlb_page_size();
+
+    std::vector<double>& cycles = backingCycles[backing];
+    size_t index = 0;
+
+    for (size_t footprint = kTlbMinFootprint; footprint <= maxFootprint; footprint *= 2, index++) {
+      build_chase(block.data, footprint);
+      double c = test_footprint();
+
+      if (index >= footprints.size())
+        footprints.push_back(footprint);
+      cycles.push_back(c);
+
+      if (_app->verbose())
+        printf("  %-8s Footprint:%-10llu: Cycles:%7.2f\n", tlb_backing_name[backing], (unsigned long long)footprint, c);
+
+      json.before_record()
+          .open_object()
+          .add_key("backing").add_string(tlb_backing_name[backing])
+          .add_key("pageSize").add_uint(pageSize)
+          .add_key("footprint").add_uint(footprint).align_to(64)
+          .add_key("pages").add_uint((footprint + pageSize - 1u) / pageSize)
+          .add_key("cycles").add_doublef("%7.2f", c)
+          .close_object();
+    }
+
+    free_backing(block);
+  }
+
+  // Lines of large footprints miss data caches as well, so reach is derived from the difference between 4KB pages
+  // and huge pages at the same footprint, which visit the same lines, but use 512 times fewer pages. Huge pages are
+  // only a control, their own reach is beyond the largest footprint.
+  const std::vector<double>& base = backingCycles[kBacking4K];
+  uint32_t control = !backingCycles[kBackingThp].empty() ? uint32_t(kBackingThp) : uint32_t(kBackingHugeTlb);
+  const std::vector<double>& controlCycles = backingCycles[control];
+
+  size_t count = std::min(base.size(), controlCycles.size());
+  if (count) {
+    std::vector<double> cost(count);
+    for (size_t i = 0; i < count; i++)
+      cost[i] = base[i] - controlCycles[i];
+
+    size_t dtlb = tlb_knee(cost, 0, kTlbDtlbKnee);
+    size_t plateau = std::min(dtlb + 1, count - 1);
+    size_t stlb = tlb_knee(cost, plateau, kTlbStlbKnee);
+
+    reaches.push_back(Reach { kBacking4K, control, size_t(4096), footprints[dtlb], footprints[stlb], cost.back() - cost[plateau] });
+  }
+  else if (_app->verbose()) {
+    printf("  TLB reach: Not available (requires huge pages as a control)\n");
+  }
+
+  json.close_array(true);
+
+  if (_app->verbose())
+    printf("\n");
+
+  json.before_record()
+      .add_key("tlbReach")
+      .open_array();
+
+  for (const Reach& reach : reaches) {
+    if (_app->verbose()) {
+      printf("  %-8s (control %s): DTLB Reach:%-10llu STLB Reach:%-10llu Walk:%7.2f\n",
+        tlb_backing_name[reach.backing], tlb_backing_name[reach.control],
+        (unsigned long long)reach.dtlb_reach, (unsigned long long)reach.stlb_reach, reach.walk_cycles);
+    }
+
+    json.before_record()
+        .open_object()
+        .add_key("backing").add_string(tlb_backing_name[reach.backing])
+        .add_key("control").add_string(tlb_backing_name[reach.control])
+        .add_key("pageSize").add_uint(reach.page_size)
+        .add_key("dtlbReach").add_uint(reach.dtlb_reach).align_to(64)
+        .add_key("stlbReach").add_uint(reach.stlb_reach)
+        .add_key("walkCycles").add_doublef("%7.2f", reach.walk_cycles)
+        .close_object();
+  }
+
+  if (_app->verbose() && !reaches.empty())
+    printf("\n");
+
+  json.close_array(true);
+}
+
+double TlbBench::test_footprint() {
+  Func func = compile_func();
+  if (!func) {
+    printf("FAILED to compile function for TLB test\n");
+    return -1.0;
+  }
+
+  uint64_t best;
+  func(_n_iter, &best);
+
+  for (uint32_t i = 1; i < kTlbRuns; i++) {
+    uint64_t n;
+    func(_n_iter, &n);
+    best = std::min(best, n);
+  }
+
+  release_func(func);
+  return double(best) / (double(_n_iter * _n_unroll));
+}
+
+void TlbBench::before_body(x86::Assembler& a) {
+  a.mov(a.zax(), uintptr_t(&_cursor));
+  a.mov(a.zsi(), x86::ptr(a.zax()));
+}
+
+void TlbBench::compile_body(x86::Assembler& a, x86::Gp reg_cnt) {
+  x86::Gp cursor = a.zsi();
+
+  Label L_Body = a.new_label();
+  Label L_End = a.new_label();
+
+  a.test(reg_cnt, reg_cnt);
+  a.jz(L_End);
+
+  a.align(AlignMode::kCode, 64);
+  a.bind(L_Body);
+
+  for (uint32_t n = 0; n < _n_unroll; n++)
+    a.mov(cursor, x86::ptr(cursor));
+
+  a.sub(reg_cnt, 1);
+  a.jnz(L_Body);
+  a.bind(L_End);
+}
+
+void TlbBench::after_body(x86::Assembler& a) {
+  a.mov(a.zax(), uintptr_t(&_cursor));
+  a.mov(x86::ptr(a.zax()), a.zsi());
+}
+
+} // {cult} namespace
@@ -0,0 +1,67 @@
+#ifndef _CULT_TLBBENCH_H
+#define _CULT_TLBBENCH_H
+
+#include <vector>
+
+#include "basebench.h"
+
+namespace cult {
+
+// ============================================================================
+// [cult::TlbBench]
+// ============================================================================
+
+// Measures TLB reach and the cost of page walks with different page sizes.
+//
+// A pointer chase visits one line of each 4KB slot of a footprint in a random order, the footprint grows from 16KB
+// to 256MB. The same chase is executed in memory backed by 4KB pages, transparent huge pages, and explicit huge
+// pages (when available), so the difference between backings shows what huge pages save. The line offset within
+// a slot rotates, so lines of consecutive slots don't map to the same cache set.
+class TlbBench : public BaseBench {
+public:
+  enum Backing : uint32_t {
+    kBacking4K,
+    kBackingThp,
+    kBackingHugeTlb,
+
+    kBackingCount
+  };
+
+  struct Block {
+    void* ptr;
+    size_t size;
+    uint8_t* data;
+    size_t data_size;
+    bool mapped;
+  };
+
+  TlbBench(App* app);
+  virtual ~TlbBench();
+
+  inline bool is_64bit() const {
+    return Environment::is_64bit(Arch::kHost);
+  }
+
+  bool alloc_backing(Block& block, uint32_t backing, size_t size);
+  void free_backing(Block& block);
+  void build_chase(uint8_t* data, size_t footprint);
+  double test_footprint();
+
+  uint32_t local_stack_size() const override;
+  void run() override;
+  void before_body(x86::Assembler& a) override;
+  void compile_body(x86::Assembler& a, x86::Gp reg_cnt) override;
+  void after_body(x86::Assembler& a) override;
+
+  uint32_t _n_iter {};
+  uint32_t _n_unroll {};
+  size_t _max_footprint {};
+
+  // Chase position, it's loaded at the beginning of each run and stored at its end.
+  uintptr_t _cursor {};
+  std::vector<uint32_t> _order;
+};
+
+} // {cult} namespace
+
+#endif // _CULT_TLBBENCH_H